@@ -61,7 +61,14 @@ done
 
 # TODO Reconstruct executable commandline instructions (platform-specific).
 mkdir -p $OUTPUT_PATH
-ln -s $INPUT_VERTEX_PATH $OUTPUT_PATH/vertex.csv
+# genCSR assigns internal ids in vertex file order. Keep that order equal to
+# the external id order, so the kernels can compare internal ids directly.
+if sort -n -c $INPUT_VERTEX_PATH 2> /dev/null; then
+  ln -s $INPUT_VERTEX_PATH $OUTPUT_PATH/vertex.csv
+else
+  echo "Sorting vertex file by id:" ["$INPUT_VERTEX_PATH"]
+  sort -n $INPUT_VERTEX_PATH > $OUTPUT_PATH/vertex.csv
+fi
 ln -s $INPUT_EDGE_PATH $OUTPUT_PATH/edge.csv
 
 [[ "$DIRECTED" == true ]] && OPENG_UNDIRECTED=0 || OPENG_UNDIRECTED=1
@@ -17,14 +17,21 @@
 //======= Breadth-first Search =======//
 //
 // Usage: ./bfs.exe --dataset <dataset path> --root <root vertex id>
+//        ./bfs.exe --dataset <dataset path> --roots <root id list or file>
 
 #include "common.h"
 #include "def.h"
 #include "perf.h"
 #include "util.hpp"
+#include "bitmap.hpp"
+#include "sliding_queue.hpp"
+#include "engine.hpp"
+#include "numa.hpp"
 #include <chrono>
 #include "openG.h"
 #include <queue>
+#include <sstream>
+#include <iterator>
 #include "omp.h"
 
 #ifdef SIM
@@ -85,143 +92,441 @@ void arg_init(argument_parser & arg)
 {
     arg.add_arg("jobid","UniqueJob","id of the openg job.");
     arg.add_arg("root","0","root/starting vertex");
+    arg.add_arg("roots","","file or comma-separated list of root vertices for a multi-source run");
+    arg.add_arg("alpha","15","switch to bottom-up when frontier edges exceed unexplored edges/alpha");
+    arg.add_arg("beta","18","switch back to top-down when frontier vertices drop below vertices/beta");
+    arg.add_arg("numa","interleave","memory placement on multi-socket machines: interleave (spread all pages over the nodes) or none");
     arg.add_arg("output", "", "Absolute path to the file where the output will be stored");
 }
 //==============================================================//
 
 
-inline unsigned vertex_distributor(uint64_t vid, unsigned threadnum)
+// Top-down step: claims unvisited out-neighbours of the frontier.
+class bfs_push
 {
-    return vid%threadnum;
-}
-#ifdef USE_CSR
-void parallel_bfs(graph_t& g, size_t root, unsigned threadnum, gBenchPerf_multi & perf, int perf_group)
+public:
+    bfs_push(graph_t &g, bitmap &visited, uint64_t level)
+        : _g(g), _visited(visited), _level(level), vertices(0), edges(0) {}
+
+    bool source(uint64_t) { return true; }
+    bool edge(uint64_t, uint64_t dst, uint64_t, uint64_t)
+    {
+        if (_visited.get_bit(dst) || !_visited.set_bit_atomic(dst))
+            return false;
+        _g.csr_vertex_property(dst).level = _level;
+        vertices++;
+        edges += _g.csr_out_edges_size(dst);
+        return true;
+    }
+
+private:
+    graph_t &_g;
+    bitmap &_visited;
+    uint64_t _level;
+public:
+    // size of the next frontier found by this thread
+    uint64_t vertices;
+    uint64_t edges;
+};
+
+// Bottom-up step: an unvisited vertex looks for a parent in the frontier
+// and stops at the first one. Runs on range_schedule, so the bitmaps are
+// written without atomics.
+class bfs_pull
+{
+public:
+    bfs_pull(graph_t &g, bitmap &visited, const bitmap &front, bitmap &next, uint64_t level)
+        : _g(g), _visited(visited), _front(front), _next(next), _level(level), vertices(0), edges(0) {}
+
+    bool target(uint64_t vid) { return !_visited.get_bit(vid); }
+    bool edge(uint64_t dst, uint64_t src, uint64_t, uint64_t)
+    {
+        if (!_front.get_bit(src))
+            return false;
+        _g.csr_vertex_property(dst).level = _level;
+        _visited.set_bit(dst);
+        _next.set_bit(dst);
+        vertices++;
+        edges += _g.csr_out_edges_size(dst);
+        return true;
+    }
+    void finish(uint64_t) {}
+
+private:
+    graph_t &_g;
+    bitmap &_visited;
+    const bitmap &_front;
+    bitmap &_next;
+    uint64_t _level;
+public:
+    uint64_t vertices;
+    uint64_t edges;
+};
+
+// Direction-optimizing BFS (Beamer et al., SC'12). Levels are expanded
+// top-down from the frontier queues until the frontier's out-edges exceed
+// 1/alpha of the edges still unexplored; from then on every unvisited vertex
+// scans its in-edges for a parent in the current level (bottom-up) until the
+// frontier shrinks below 1/beta of the vertices again.
+//
+// Visited vertices are tracked in a separate bitmap, and bottom-up levels
+// keep the frontier as a bitmap as well, so the vertex properties are only
+// touched once, to write the level of a newly discovered vertex.
+void parallel_bfs(graph_t& g, size_t root, unsigned threadnum, double alpha, double beta,
+                  gBenchPerf_multi & perf, int perf_group)
 {
+    uint64_t vertex_num = g.num_vertices();
+
     // initializzation
     g.csr_vertex_property(root).level = 0;
 
-    vector<vector<uint64_t> > global_input_tasks(threadnum);
-    global_input_tasks[vertex_distributor(root, threadnum)].push_back(root);
-    
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
+    bitmap visited(vertex_num);
+    visited.set_bit(root);
+
+    vertex_frontier frontier(vertex_num);
+    frontier.queue.push_back(root);
+    frontier.queue.slide_window();
+
+    // per-thread size of the next frontier, in vertices and in out-edges
+    vector<uint64_t> frontier_vertices(threadnum, 0);
+    vector<uint64_t> frontier_edges(threadnum, 0);
+
+    uint64_t curr_level = 0;
+    uint64_t edges_to_check = g.num_edges();
+    uint64_t scout_count = g.csr_out_edges_size(root);
+    uint64_t awake_count = 1;
+    bool bottom_up = false;
+    bool was_bottom_up = false;
 
     bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks,perf) 
+    #pragma omp parallel num_threads(threadnum) shared(stop,frontier,perf) 
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        queue_buffer<uint64_t> local_queue(frontier.queue);
+        uint64_t range_begin, range_end;
+        frontier.thread_range(tid, threadnum, range_begin, range_end);
       
         perf.open(tid, perf_group);
         perf.start(tid, perf_group); 
         while(!stop)
         {
-            #pragma omp barrier
-            // process local queue
-            stop = true;
-        
-            for (unsigned i=0;i<input_tasks.size();i++)
+            if (bottom_up)
             {
-                uint64_t vid=input_tasks[i];
-                uint16_t curr_level = g.csr_vertex_property(vid).level;
-                uint64_t edges_begin = g.csr_out_edges_begin(vid);
-                uint64_t size = g.csr_out_edges_size(vid);
-
-                for (unsigned i=0;i<size;i++)
-                {
-                    uint64_t dest_vid = g.csr_out_edge(edges_begin, i);
-                    if (__sync_bool_compare_and_swap(&(g.csr_vertex_property(dest_vid).level), 
-                                MY_INFINITY,curr_level+1))
-                    {
-                        global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                    }
-                }
+                bfs_pull step(g, visited, frontier.current_bits(), frontier.next_bits(), curr_level+1);
+                edge_map_pull<IN_EDGES>(g, vertex_num, range_schedule(), step);
+                frontier_vertices[tid] = step.vertices;
+                frontier_edges[tid] = step.edges;
+            }
+            else
+            {
+                bfs_push step(g, visited, curr_level+1);
+                edge_map_push<OUT_EDGES>(g, frontier.queue, local_queue, dynamic_schedule<64>(), step);
+                frontier_vertices[tid] = step.vertices;
+                frontier_edges[tid] = step.edges;
             }
             #pragma omp barrier
-            input_tasks.clear();
-            for (unsigned i=0;i<threadnum;i++)
+            if (tid==0)
             {
-                if (global_output_tasks[i*threadnum+tid].size()!=0)
+                uint64_t prev_awake_count = awake_count;
+                edges_to_check -= (scout_count < edges_to_check) ? scout_count : edges_to_check;
+                awake_count = 0;
+                scout_count = 0;
+                for (unsigned i=0;i<threadnum;i++)
                 {
-                    stop = false;
-                    input_tasks.insert(input_tasks.end(),
-                            global_output_tasks[i*threadnum+tid].begin(),
-                            global_output_tasks[i*threadnum+tid].end());
-                    global_output_tasks[i*threadnum+tid].clear();
+                    awake_count += frontier_vertices[i];
+                    scout_count += frontier_edges[i];
                 }
+
+                cout<<"== level "<<curr_level<<": "<<(bottom_up ? "bottom-up" : "top-down")
+                    <<", next frontier "<<awake_count<<" vertices "<<scout_count<<" edges\n";
+
+                was_bottom_up = bottom_up;
+                if (!bottom_up)
+                    bottom_up = scout_count > edges_to_check / alpha;
+                else
+                    bottom_up = awake_count >= prev_awake_count || awake_count > vertex_num / beta;
+                if (was_bottom_up)
+                    frontier.swap_bits();
+                else
+                    frontier.queue.slide_window();
+                stop = (awake_count == 0);
+                curr_level++;
             }
             #pragma omp barrier
+
+            // convert the frontier between queue and bitmap form when the
+            // direction changes; all threads take the same branch here
+            if (bottom_up)
+            {
+                frontier.next_bits().reset(range_begin, range_end);
+                if (!was_bottom_up)
+                    frontier.to_dense(tid, threadnum);
+            }
+            else if (was_bottom_up)
+            {
+                frontier.to_sparse(local_queue, tid, threadnum);
+            }
         }
         perf.stop(tid, perf_group);
     }
 }
 
-#else
-void parallel_bfs(graph_t& g, size_t root, unsigned threadnum, gBenchPerf_multi & perf, int perf_group)
+// Set of BFS sources, one bit per source of the current batch.
+template <unsigned WORDS>
+struct source_mask
 {
-    // initializzation
-    vertex_iterator rootvit=g.find_vertex(root);
-    if (rootvit==g.vertices_end()) return;
+    uint64_t bits[WORDS];
 
-    rootvit->property().level = 0;
+    void clear(void)
+    {
+        for (unsigned w=0;w<WORDS;w++) bits[w] = 0;
+    }
+    bool any(void) const
+    {
+        uint64_t r = 0;
+        for (unsigned w=0;w<WORDS;w++) r |= bits[w];
+        return r != 0;
+    }
+    bool covers(const source_mask &that) const
+    {
+        uint64_t r = 0;
+        for (unsigned w=0;w<WORDS;w++) r |= that.bits[w] & ~bits[w];
+        return r == 0;
+    }
+};
 
-    vector<vector<uint64_t> > global_input_tasks(threadnum);
-    global_input_tasks[vertex_distributor(root, threadnum)].push_back(root);
+// Multi-source BFS (Then et al., VLDB'14): every vertex keeps a bitmask of
+// the sources that have reached it, so one scan of an edge advances all
+// sources of the batch at once. Sparse levels push along out-edges with
+// atomic ORs, dense levels pull over in-edges without any atomics; the
+// switch uses the same alpha as the single-source kernel.
+//
+// levels is vertex-major with one column per root; this batch fills the
+// columns [first, first+count), count <= 64*WORDS.
+template <unsigned WORDS>
+void parallel_msbfs(graph_t& g, const vector<uint64_t> &roots, size_t first, size_t count,
+                    unsigned threadnum, double alpha, vector<uint32_t> &levels)
+{
+    typedef source_mask<WORDS> mask_t;
+    uint64_t vertex_num = g.num_vertices();
+    size_t stride = roots.size();
 
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
+    vector<mask_t> seen(vertex_num), visit(vertex_num), visit_next(vertex_num);
 
-    bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks,perf)
+    mask_t batch;
+    batch.clear();
+    for (size_t j=0;j<count;j++)
     {
-        unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        batch.bits[j/64] |= (uint64_t) 1 << (j%64);
+    }
 
-        perf.open(tid, perf_group);
-        perf.start(tid, perf_group);
-        while(!stop)
-        {
-            #pragma omp barrier
-            // process local queue
-            stop = true;
+    uint64_t scout_count = 0;
+    #pragma omp parallel for num_threads(threadnum)
+    for (uint64_t vid=0;vid<vertex_num;vid++)
+    {
+        seen[vid].clear();
+        visit[vid].clear();
+        visit_next[vid].clear();
+    }
+    for (size_t j=0;j<count;j++)
+    {
+        uint64_t vid = roots[first+j];
+        seen[vid].bits[j/64] |= (uint64_t) 1 << (j%64);
+        visit[vid].bits[j/64] |= (uint64_t) 1 << (j%64);
+        levels[vid*stride + first+j] = 0;
+    }
+    for (size_t j=0;j<count;j++)
+    {
+        scout_count += g.csr_out_edges_size(roots[first+j]);
+    }
 
+    uint32_t curr_level = 0;
+    uint64_t awake_count = count;
+    bool pull = false;
+    while (awake_count != 0)
+    {
+        pull = scout_count > g.num_edges() / alpha;
+        awake_count = 0;
+        scout_count = 0;
 
-            for (unsigned i=0;i<input_tasks.size();i++)
+        if (pull)
+        {
+            #pragma omp parallel for num_threads(threadnum) schedule(dynamic, 1024) reduction(+:awake_count,scout_count)
+            for (uint64_t vid=0;vid<vertex_num;vid++)
             {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
-                uint32_t curr_level = vit->property().level;
+                if (seen[vid].covers(batch))
+                    continue;
+
+                mask_t found;
+                found.clear();
+                uint64_t edges_begin = g.csr_in_edges_begin(vid);
+                uint64_t size = g.csr_in_edges_size(vid);
+                for (uint64_t i=0;i<size;i++)
+                {
+                    const mask_t &src = visit[g.csr_in_edge(edges_begin, i)];
+                    for (unsigned w=0;w<WORDS;w++) found.bits[w] |= src.bits[w];
+                }
+                for (unsigned w=0;w<WORDS;w++) found.bits[w] &= ~seen[vid].bits[w];
+                if (!found.any())
+                    continue;
 
-                for (edge_iterator eit=vit->edges_begin();eit!=vit->edges_end();eit++)
+                visit_next[vid] = found;
+                for (unsigned w=0;w<WORDS;w++)
                 {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator destvit = g.find_vertex(dest_vid);
-                    if (__sync_bool_compare_and_swap(&(destvit->property().level),
-                                                     MY_INFINITY,curr_level+1))
-                    {
-                        global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                    }
+                    seen[vid].bits[w] |= found.bits[w];
+                    for (uint64_t b=found.bits[w];b!=0;b&=b-1)
+                        levels[vid*stride + first + w*64 + __builtin_ctzll(b)] = curr_level+1;
                 }
+                awake_count++;
+                scout_count += g.csr_out_edges_size(vid);
             }
-            #pragma omp barrier
-            input_tasks.clear();
-            for (unsigned i=0;i<threadnum;i++)
+        }
+        else
+        {
+            #pragma omp parallel for num_threads(threadnum) schedule(dynamic, 1024) reduction(+:awake_count,scout_count)
+            for (uint64_t vid=0;vid<vertex_num;vid++)
             {
-                if (global_output_tasks[i*threadnum+tid].size()!=0)
+                if (!visit[vid].any())
+                    continue;
+
+                uint64_t edges_begin = g.csr_out_edges_begin(vid);
+                uint64_t size = g.csr_out_edges_size(vid);
+                for (uint64_t i=0;i<size;i++)
                 {
-                    stop = false;
-                    input_tasks.insert(input_tasks.end(),
-                                       global_output_tasks[i*threadnum+tid].begin(),
-                                       global_output_tasks[i*threadnum+tid].end());
-                    global_output_tasks[i*threadnum+tid].clear();
+                    uint64_t dest_vid = g.csr_out_edge(edges_begin, i);
+                    bool woken = false;
+                    for (unsigned w=0;w<WORDS;w++)
+                    {
+                        uint64_t found = visit[vid].bits[w] & ~seen[dest_vid].bits[w];
+                        if (found == 0)
+                            continue;
+                        // only the bits this thread flipped are recorded here
+                        found &= ~__sync_fetch_and_or(&(seen[dest_vid].bits[w]), found);
+                        if (found == 0)
+                            continue;
+                        if (__sync_fetch_and_or(&(visit_next[dest_vid].bits[w]), found) == 0)
+                            woken = true;
+                        for (uint64_t b=found;b!=0;b&=b-1)
+                            levels[dest_vid*stride + first + w*64 + __builtin_ctzll(b)] = curr_level+1;
+                    }
+                    if (woken)
+                    {
+                        awake_count++;
+                        scout_count += g.csr_out_edges_size(dest_vid);
+                    }
                 }
             }
-#pragma omp barrier
+        }
+
+        cout<<"== level "<<curr_level<<": "<<(pull ? "pull" : "push")
+            <<", next frontier "<<awake_count<<" vertices "<<scout_count<<" edges\n";
 
+        visit.swap(visit_next);
+        #pragma omp parallel for num_threads(threadnum)
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            visit_next[vid].clear();
         }
-        perf.stop(tid, perf_group);
+        curr_level++;
     }
+}
 
+// Run the roots in batches of up to 256 sources, one mask word per 64.
+void parallel_msbfs(graph_t& g, const vector<uint64_t> &roots, unsigned threadnum, double alpha,
+                    vector<uint32_t> &levels, gBenchPerf_multi & perf, int perf_group)
+{
+    levels.assign(g.num_vertices() * roots.size(), numeric_limits<uint32_t>::max());
+
+    #pragma omp parallel num_threads(threadnum)
+    {
+        unsigned tid = omp_get_thread_num();
+        perf.open(tid, perf_group);
+        perf.start(tid, perf_group);
+    }
+    for (size_t first=0;first<roots.size();first+=256)
+    {
+        size_t count = roots.size() - first;
+        if (count > 256) count = 256;
+
+        cout<<"== batch of "<<count<<" roots\n";
+        if (count <= 64)
+            parallel_msbfs<1>(g, roots, first, count, threadnum, alpha, levels);
+        else if (count <= 128)
+            parallel_msbfs<2>(g, roots, first, count, threadnum, alpha, levels);
+        else
+            parallel_msbfs<4>(g, roots, first, count, threadnum, alpha, levels);
+    }
+    #pragma omp parallel num_threads(threadnum)
+    {
+        perf.stop(omp_get_thread_num(), perf_group);
+    }
 }
-#endif
+
+// Write one line per vertex: its external id followed by its level for every root.
+bool write_csr_msbfs_levels(graph_t &g, const string &file, const vector<uint32_t> &levels, size_t root_num)
+{
+    ofstream f(file.c_str());
+
+    if (!f) {
+        cerr << "failed to open file: " << file << endl;
+        return false;
+    }
+
+    for (uint64_t vid=0;vid<g.vertex_num();vid++)
+    {
+        f << g.csr_external_id(vid);
+        for (size_t j=0;j<root_num;j++)
+        {
+            uint32_t level = levels[vid*root_num + j];
+            if (level == numeric_limits<uint32_t>::max())
+                f << " " << numeric_limits<int64_t>::max();
+            else
+                f << " " << level;
+        }
+        f << "\n";
+    }
+    f.close();
+
+    if (f.bad()) {
+        cerr << "error while writing to file: " << file << endl;
+        return false;
+    }
+
+    return true;
+}
+
+// The roots option is either a file or a comma-separated list of external ids.
+bool parse_roots(const string &value, vector<uint64_t> &roots)
+{
+    string text = value;
+    ifstream f(value.c_str());
+    if (f)
+    {
+        text.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+    }
+
+    for (size_t i=0;i<text.size();i++)
+    {
+        if (text[i] == ',') text[i] = ' ';
+    }
+
+    stringstream ss(text);
+    string token;
+    while (ss >> token)
+    {
+        char *end;
+        uint64_t id = strtoull(token.c_str(), &end, 10);
+        if (*end != '\0')
+        {
+            cerr << "invalid root vertex id: " << token << endl;
+            return false;
+        }
+        roots.push_back(id);
+    }
+
+    return !roots.empty();
+}
+
 
 void output(graph_t& g)
 {
@@ -282,8 +587,26 @@ int main(int argc, char * argv[])
     size_t root,threadnum;
     arg.get_value("root",root);
     arg.get_value("threadnum",threadnum);
+    string numa_mode;
+    arg.get_value("numa",numa_mode);
+    if (numa_mode != "interleave" && numa_mode != "none") {
+        cerr << "unknown numa mode: " << numa_mode << endl;
+        return 1;
+    }
     arg.get_value("jobid",jobId);
 
+    double alpha, beta;
+    arg.get_value("alpha",alpha);
+    arg.get_value("beta",beta);
+
+    string roots_value;
+    arg.get_value("roots",roots_value);
+    vector<uint64_t> external_roots, roots;
+    if (!roots_value.empty() && !parse_roots(roots_value, external_roots)) {
+        cerr << "no valid root vertices in: " << roots_value << endl;
+        return 1;
+    }
+
 #ifdef GRANULA
     granula::linkNode(jobId);
     granula::linkProcess(getpid(), jobId);
@@ -298,19 +621,12 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("StartTime", loadGraph.getEpoch())<<endl;
 #endif
 
+    numa_placement placement(numa_mode, threadnum);
+    placement.before_load();
     t1 = timer::get_usec();
-    string vfile = path + "/vertex.csv";
-    string efile = path + "/edge.csv";
 
-#ifdef USE_CSR
     if (!graph.load_CSR_Graph(path))
         return -1;
-#else
-    if (!graph.load_csv_vertices(vfile, false, " ", 0))
-        return -1;
-    if (!graph.load_csv_edges(efile, false, " ", 0, 1))
-        return -1;
-#endif
     size_t vertex_num = graph.vertex_num();
     size_t edge_num = graph.edge_num();
     t2 = timer::get_usec();
@@ -321,18 +637,24 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("EndTime", loadGraph.getEpoch())<<endl;
 #endif
 
-#ifdef USE_CSR
     uint64_t newroot;
+    bool ids_ordered = csr_ids_ordered(threadnum, graph);
+
+    if (!external_roots.empty()) {
+        if (!csr_external_to_internal_ids(threadnum, graph, external_roots, roots, ids_ordered))
+            return 1;
+        cout<<"\nBFS roots: "<<roots.size()<<"\n";
+    } else {
+        if (!csr_external_to_internal_id(threadnum, graph, root, newroot, ids_ordered)) {
+            cerr << "failed find vertex with external id: " << root << endl;
+            return 1;
+        }
 
-    if (!csr_external_to_internal_id(threadnum, graph, root, newroot)) {
-        cerr << "failed find vertex with external id: " << root << endl;
-        return 1;
+        root = newroot;
+        cout<<"\nBFS root: "<<root<<"\n";
     }
 
-    root = newroot;
-#endif
-
-    cout<<"\nBFS root: "<<root<<"\n";
+    vector<uint32_t> msbfs_levels;
 
     gBenchPerf_multi perf_multi(threadnum, perf);
     unsigned run_num = ceil(perf.get_event_cnt() /(double) DEFAULT_PERF_GRP_SZ);
@@ -348,7 +670,10 @@ int main(int argc, char * argv[])
     for (unsigned i=0;i<run_num;i++)
     {
         t1 = timer::get_usec();
-        parallel_bfs(graph, root, threadnum, perf_multi, i);
+        if (!roots.empty())
+            parallel_msbfs(graph, roots, threadnum, alpha, msbfs_levels, perf_multi, i);
+        else
+            parallel_bfs(graph, root, threadnum, alpha, beta, perf_multi, i);
         t2 = timer::get_usec();
         elapse_time += t2-t1;
         if ((i+1)<run_num) reset_graph(graph);
@@ -374,11 +699,10 @@ int main(int argc, char * argv[])
     arg.get_value("output", output_file);
 
     if (!output_file.empty()) {
-#ifdef USE_CSR
-        write_csr_graph_vertices(graph, output_file);
-#else
-        write_graph_vertices(graph, output_file);
-#endif
+        if (!roots.empty())
+            write_csr_msbfs_levels(graph, output_file, msbfs_levels, roots.size());
+        else
+            write_csr_graph_vertices(graph, output_file);
     }
 
 #ifdef GRANULA
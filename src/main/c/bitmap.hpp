@@ -0,0 +1,88 @@
+/*
+ * Copyright 2015 Delft University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <cstring>
+#include <stdint.h>
+
+// One bit per vertex. Plain set/get are meant for word-aligned vertex ranges
+// owned by a single thread; set_bit_atomic may be used from any thread.
+class bitmap
+{
+public:
+    explicit bitmap(uint64_t size)
+        : _size(size), _num_words((size + 63) / 64), _words(new uint64_t[_num_words])
+    {
+        reset();
+    }
+    ~bitmap()
+    {
+        delete[] _words;
+    }
+
+    uint64_t size(void) const
+    {
+        return _size;
+    }
+
+    // clear all bits
+    void reset(void)
+    {
+        memset(_words, 0, sizeof(uint64_t) * _num_words);
+    }
+
+    // clear the bits in [begin, end), begin must be a multiple of 64
+    void reset(uint64_t begin, uint64_t end)
+    {
+        uint64_t word_begin = begin / 64;
+        uint64_t word_end = (end + 63) / 64;
+        if (word_end > word_begin)
+            memset(_words + word_begin, 0, sizeof(uint64_t) * (word_end - word_begin));
+    }
+
+    bool get_bit(uint64_t pos) const
+    {
+        return (_words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    void set_bit(uint64_t pos)
+    {
+        _words[pos / 64] |= (uint64_t) 1 << (pos % 64);
+    }
+
+    // returns true if this call flipped the bit from 0 to 1
+    bool set_bit_atomic(uint64_t pos)
+    {
+        uint64_t mask = (uint64_t) 1 << (pos % 64);
+        return (__sync_fetch_and_or(&_words[pos / 64], mask) & mask) == 0;
+    }
+
+    void clear_bit_atomic(uint64_t pos)
+    {
+        __sync_fetch_and_and(&_words[pos / 64], ~((uint64_t) 1 << (pos % 64)));
+    }
+
+private:
+    bitmap(const bitmap &);
+    bitmap & operator=(const bitmap &);
+
+    uint64_t _size;
+    uint64_t _num_words;
+    uint64_t * _words;
+};
+
+#endif
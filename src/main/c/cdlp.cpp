@@ -26,6 +26,9 @@
 #include <unordered_map>
 #include "omp.h"
 #include "util.hpp"
+#include "bitmap.hpp"
+#include "engine.hpp"
+#include "numa.hpp"
 #include <chrono>
 
 #ifdef GRANULA
@@ -70,242 +73,362 @@ void arg_init(argument_parser & arg)
 {
     arg.add_arg("jobid","UniqueJob","id of the openg job.");
     arg.add_arg("iteration","10","cdlp iterations");
+    arg.add_arg("mode","incremental","cdlp kernel: incremental (recompute neighbours of changed vertices only) or full");
+    arg.add_arg("hubdegree","8192","vertices with at least this many edges are processed by all threads together; 0 disables");
+    arg.add_arg("numa","interleave","memory placement on multi-socket machines: interleave (spread all pages over the nodes) or none");
     arg.add_arg("output", "", "Absolute path to the file where the output will be stored");
 }
 //==============================================================//
-inline unsigned vertex_distributor(uint64_t vid, unsigned threadnum)
-{
-    return vid%threadnum;
-}
-#ifdef USE_CSR
 void parallel_init(graph_t& g, unsigned threadnum,
                    vector<uint64_t> & workset)
 {
     #pragma omp parallel num_threads(threadnum)
     {
-        unsigned tid = omp_get_thread_num();
-        unsigned start = workset[tid];
-        unsigned end = workset[tid+1];
-
-        for (uint64_t vid=start;vid<end;vid++)
-        {
+        vertex_map(g.num_vertices(), chunk_schedule(workset), [&](uint64_t vid) {
             g.csr_vertex_property(vid).label = vid;
-        }
-
+        });
     }
 }
-void gen_workset(graph_t& g, vector<uint64_t>& workset, unsigned threadnum)
+// Per-thread label histogram, allocated once and reused for every vertex.
+// Vertices with at most small_degree neighbours collect their labels in a
+// fixed buffer and sort them; larger ones count in an open-addressing table
+// sized for the maximum degree, which is cleared by walking the touched slots.
+// Ties go to the smallest external id; if internal ids follow external id
+// order, labels are compared directly instead. Hub vertices are counted by
+// all threads together through add/drain/take_best.
+class label_histogram
 {
-    unsigned chunk = (unsigned)ceil(g.num_edges()/(double)threadnum);
-    unsigned last=0, curr=0, th=1;
-    workset.clear();
-    workset.resize(threadnum+1,0);
-    for (uint64_t vid=0;vid<g.vertex_num();vid++)
+public:
+    static const uint64_t small_degree = 32;
+
+    label_histogram(uint64_t max_degree, bool ids_ordered)
+        : _ids_ordered(ids_ordered)
+    {
+        uint64_t capacity = 64;
+        while (capacity < 2 * max_degree) capacity *= 2;
+        _mask = capacity - 1;
+        _keys.resize(capacity, empty_key);
+        _counts.resize(capacity, 0);
+        _touched.resize(max_degree);
+        _num_touched = 0;
+    }
+
+    // most frequent label among the in- and out-neighbours of vid,
+    // ties broken by the smallest external id
+    uint64_t best_label(graph_t &g, uint64_t vid)
     {
-        curr += g.csr_out_edges_size(vid);
+        uint64_t in_begin = g.csr_in_edges_begin(vid);
+        uint64_t in_size = g.csr_in_edges_size(vid);
+        uint64_t out_begin = g.csr_out_edges_begin(vid);
+        uint64_t out_size = g.csr_out_edges_size(vid);
 
-        if ((curr-last)>=chunk)
+        if (in_size + out_size <= small_degree)
         {
-            last = curr;
-            workset[th] = vid;
-            if (th<threadnum) th++;
+            uint64_t labels[small_degree];
+            uint64_t num = 0;
+            for (uint64_t i=0;i<in_size;i++)
+                labels[num++] = g.csr_vertex_property(g.csr_in_edge(in_begin, i)).label;
+            for (uint64_t i=0;i<out_size;i++)
+                labels[num++] = g.csr_vertex_property(g.csr_out_edge(out_begin, i)).label;
+            return best_sorted(g, labels, num);
         }
+
+        for (uint64_t i=0;i<in_size;i++)
+            add(g.csr_vertex_property(g.csr_in_edge(in_begin, i)).label, 1);
+        for (uint64_t i=0;i<out_size;i++)
+            add(g.csr_vertex_property(g.csr_out_edge(out_begin, i)).label, 1);
+
+        uint64_t best, highest_freq;
+        take_best(g, best, highest_freq);
+        return best;
     }
-    workset[threadnum] = g.num_vertices();
-    for (unsigned i=threadnum-1;i>=1;i--)
+
+    bool label_less(graph_t &g, uint64_t a, uint64_t b) const
     {
-        if (workset[i]==0)
-            workset[i]=workset[i+1];
+        if (_ids_ordered)
+            return a < b;
+        return g.csr_external_id(a) < g.csr_external_id(b);
     }
-}
-#else
-void parallel_init(graph_t& g, unsigned threadnum,
-                   vector<vector<uint64_t> >& global_input_tasks)
-{
-    global_input_tasks.resize(threadnum);
-    for (vertex_iterator vit=g.vertices_begin(); vit!=g.vertices_end(); vit++)
+
+    // count further occurrences of label in the table
+    void add(uint64_t label, uint64_t count)
     {
-        vit->property().label = vit->id();
-        global_input_tasks[vertex_distributor(vit->id(), threadnum)].push_back(vit->id());
+        uint64_t slot = (label * 0x9E3779B97F4A7C15ULL >> 32) & _mask;
+        while (_keys[slot] != label)
+        {
+            if (_keys[slot] == empty_key)
+            {
+                _keys[slot] = label;
+                _touched[_num_touched++] = slot;
+                break;
+            }
+            slot = (slot + 1) & _mask;
+        }
+        _counts[slot] += count;
+    }
 
+    // move the counted labels to out and clear the table, returns their number
+    uint64_t drain(pair<uint64_t, uint64_t> * out)
+    {
+        for (uint64_t i=0;i<_num_touched;i++)
+        {
+            uint64_t slot = _touched[i];
+            out[i] = make_pair(_keys[slot], _counts[slot]);
+            _keys[slot] = empty_key;
+            _counts[slot] = 0;
+        }
+        uint64_t num = _num_touched;
+        _num_touched = 0;
+        return num;
     }
-}
-#endif
-#ifdef USE_CSR
-void parallel_cdlp(graph_t &g, size_t iteration, unsigned threadnum,
-                    vector<uint64_t> & workset,
-                   //vector<vector<uint64_t> > &global_input_tasks,
-                   gBenchPerf_multi &perf, int perf_group)
-{
-    //vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
-    size_t step = 0;
-    bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,workset)
+
+    // most frequent label in the table and its count; clears the table
+    void take_best(graph_t &g, uint64_t &best, uint64_t &highest_freq)
     {
-        unsigned tid = omp_get_thread_num();
-        unsigned start = workset[tid];
-        unsigned end = workset[tid+1];
+        best = 0;
+        highest_freq = 0;
+        for (uint64_t i=0;i<_num_touched;i++)
+        {
+            uint64_t slot = _touched[i];
+            uint64_t label = _keys[slot];
+            uint64_t freq = _counts[slot];
+            if (freq > highest_freq || (freq == highest_freq && label_less(g, label, best)))
+            {
+                best = label;
+                highest_freq = freq;
+            }
+            _keys[slot] = empty_key;
+            _counts[slot] = 0;
+        }
+        _num_touched = 0;
+    }
 
-        perf.open(tid, perf_group);
-        perf.start(tid, perf_group);
+private:
+    static const uint64_t empty_key = UINT64_MAX;
 
-        while(!stop)
+    uint64_t best_sorted(graph_t &g, uint64_t * labels, uint64_t num)
+    {
+        for (uint64_t i=1;i<num;i++)
         {
+            uint64_t label = labels[i];
+            uint64_t j = i;
+            for (;j>0 && labels[j-1]>label;j--)
+                labels[j] = labels[j-1];
+            labels[j] = label;
+        }
 
-            #pragma omp barrier
-            for (unsigned vid=start;vid<end;vid++)
+        uint64_t best = 0;
+        uint64_t highest_freq = 0;
+        uint64_t i = 0;
+        while (i < num)
+        {
+            uint64_t j = i + 1;
+            while (j < num && labels[j] == labels[i]) j++;
+            uint64_t freq = j - i;
+            if (freq > highest_freq || (freq == highest_freq && label_less(g, labels[i], best)))
             {
-                unordered_map<uint64_t, uint64_t> histogram;
-                uint64_t edges_begin = g.csr_in_edges_begin(vid);
-                uint64_t size = g.csr_in_edges_size(vid);
-
-                for (uint64_t i=0;i<size;i++)
-                {
-                    uint64_t dest_vid = g.csr_in_edge(edges_begin, i);
+                best = labels[i];
+                highest_freq = freq;
+            }
+            i = j;
+        }
+        return best;
+    }
 
-                    if(histogram.find(g.csr_vertex_property(dest_vid).label) == histogram.end()) {
-                        histogram[g.csr_vertex_property(dest_vid).label] = 1;
-                    } else {
-                        histogram[g.csr_vertex_property(dest_vid).label] += 1;
-                    }
-                }
+    bool _ids_ordered;
+    uint64_t _mask;
+    vector<uint64_t> _keys;
+    vector<uint64_t> _counts;
+    vector<uint64_t> _touched;
+    uint64_t _num_touched;
+};
+const uint64_t label_histogram::small_degree;
+const uint64_t label_histogram::empty_key;
 
-                edges_begin = g.csr_out_edges_begin(vid);
-                size = g.csr_out_edges_size(vid);
-                for (uint64_t i=0;i<size;i++)
-                {
-                    uint64_t dest_vid = g.csr_out_edge(edges_begin, i);
-                    
-                    if(histogram.find(g.csr_vertex_property(dest_vid).label) == histogram.end()) {
-                        histogram[g.csr_vertex_property(dest_vid).label] = 1;
-                    } else {
-                        histogram[g.csr_vertex_property(dest_vid).label] += 1;
-                    }
-                }
+uint64_t max_degree(graph_t &g)
+{
+    uint64_t result = 0;
+    for (uint64_t vid=0;vid<g.num_vertices();vid++)
+    {
+        uint64_t degree = g.csr_in_edges_size(vid) + g.csr_out_edges_size(vid);
+        if (degree > result) result = degree;
+    }
+    return result;
+}
 
-                uint64_t bestLabel = 0;
-                uint64_t highest_freq = 0;
-                for ( auto it = histogram.begin(); it != histogram.end(); ++it ) {
-                    uint64_t label = it->first;
-                    uint64_t freq = it->second;
-                    if (freq > highest_freq || (freq == highest_freq &&  g.csr_external_id(label) < g.csr_external_id(bestLabel))) {
-                        bestLabel = label;
-                        highest_freq = freq;
-                    }
-                }
-                g.csr_vertex_property(vid).next_label = bestLabel;
+// vertices with at least hub_degree in- plus out-edges
+void collect_hubs(graph_t &g, uint64_t hub_degree, vector<uint64_t> &hubs)
+{
+    hubs.clear();
+    for (uint64_t vid=0;vid<g.num_vertices();vid++)
+    {
+        if (g.csr_in_edges_size(vid) + g.csr_out_edges_size(vid) >= hub_degree)
+            hubs.push_back(vid);
+    }
+}
 
-                histogram.clear();
-            }
+// marks the neighbours of a vertex whose label changed for the next iteration
+class cdlp_activate
+{
+public:
+    explicit cdlp_activate(bitmap &next_active) : _next_active(next_active) {}
 
-            #pragma omp barrier
-            for (unsigned vid=start;vid<end;vid++)
-            {
-                g.csr_vertex_property(vid).label = g.csr_vertex_property(vid).next_label;
-            }
+    bool edge(uint64_t, uint64_t dst, uint64_t, uint64_t)
+    {
+        _next_active.set_bit_atomic(dst);
+        return false;
+    }
 
-            #pragma omp barrier
-            if(tid==0) {
-                step++;
+private:
+    bitmap &_next_active;
+};
 
-                if(step >= iteration) {
-                    stop = true;
-                }
-            }
-            #pragma omp barrier
-        }
-        perf.stop(tid, perf_group);
-    }
-}
-#else
+// In incremental mode an iteration only recomputes the in- and out-neighbours
+// of vertices whose label changed in the previous iteration; every other
+// vertex would get the same histogram again and keeps its label. The run
+// stops early once no label changes.
+//
+// Hub vertices are skipped by the thread that takes their chunk and handled
+// by all threads afterwards: each thread counts a slice of the neighbour list,
+// then merges the labels it owns (label % threadnum) from all partial
+// histograms, and thread 0 picks the best of the per-owner winners.
 void parallel_cdlp(graph_t &g, size_t iteration, unsigned threadnum,
-                   vector<vector<uint64_t> > &global_input_tasks,
+                    vector<uint64_t> & workset, uint64_t max_degree, bool ids_ordered, bool incremental,
+                    vector<uint64_t> & hubs, uint64_t hub_degree,
                    gBenchPerf_multi &perf, int perf_group)
 {
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
     size_t step = 0;
     bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks)
+    uint64_t vertex_num = g.num_vertices();
+    bitmap active_a(vertex_num), active_b(vertex_num);
+    bitmap * active = &active_a;
+    bitmap * next_active = &active_b;
+    vector<uint64_t> active_counts(threadnum, 0);
+    vector<uint64_t> changed_counts(threadnum, 0);
+    vector<vector<pair<uint64_t, uint64_t> > > partials(threadnum);
+    vector<uint64_t> partial_sizes(threadnum, 0);
+    vector<pair<uint64_t, uint64_t> > candidates(threadnum);
+    chunk_schedule schedule(workset);
+    #pragma omp parallel num_threads(threadnum) shared(stop,workset)
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        label_histogram histogram(max_degree, ids_ordered);
+        uint64_t slice_begin, slice_end;
+        aligned_range(vertex_num, 64, tid, threadnum, slice_begin, slice_end);
+        if (!hubs.empty())
+            partials[tid].resize(max_degree / threadnum + 1);
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
+
         while(!stop)
         {
 
             #pragma omp barrier
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
-
-                unordered_map<uint64_t, uint64_t> histogram;
-
-                for (edge_iterator eit=vit->in_edges_begin();eit!=vit->in_edges_end();eit++)
+            uint64_t active_count = 0;
+            vertex_map(vertex_num, schedule, [&](uint64_t vid) {
+                if (incremental && step > 0 && !active->get_bit(vid))
                 {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator destvit = g.find_vertex(dest_vid);
-                    if(histogram.find(destvit->property().label) == histogram.end()) {
-                        histogram[destvit->property().label] = 1;
-                    } else {
-                        histogram[destvit->property().label] += 1;
-                    }
-
+                    g.csr_vertex_property(vid).next_label = g.csr_vertex_property(vid).label;
+                    return;
+                }
+                if (!hubs.empty() && g.csr_in_edges_size(vid) + g.csr_out_edges_size(vid) >= hub_degree)
+                    return;
+                g.csr_vertex_property(vid).next_label = histogram.best_label(g, vid);
+                active_count++;
+            });
 
+            for (size_t h=0;h<hubs.size();h++)
+            {
+                uint64_t vid = hubs[h];
+                if (incremental && step > 0 && !active->get_bit(vid))
+                    continue;
+
+                uint64_t in_begin = g.csr_in_edges_begin(vid);
+                uint64_t in_size = g.csr_in_edges_size(vid);
+                uint64_t out_begin = g.csr_out_edges_begin(vid);
+                uint64_t degree = in_size + g.csr_out_edges_size(vid);
+                uint64_t chunk_end = degree * (tid + 1) / threadnum;
+                for (uint64_t i=degree*tid/threadnum;i<chunk_end;i++)
+                {
+                    uint64_t dest_vid = (i < in_size) ? g.csr_in_edge(in_begin, i)
+                                                      : g.csr_out_edge(out_begin, i - in_size);
+                    histogram.add(g.csr_vertex_property(dest_vid).label, 1);
                 }
-                for (edge_iterator eit=vit->out_edges_begin();eit!=vit->out_edges_end();eit++)
+                partial_sizes[tid] = histogram.drain(partials[tid].data());
+
+                #pragma omp barrier
+                for (unsigned t=0;t<threadnum;t++)
                 {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator destvit = g.find_vertex(dest_vid);
-                    if(histogram.find(destvit->property().label) == histogram.end()) {
-                        histogram[destvit->property().label] = 1;
-                    } else {
-                        histogram[destvit->property().label] += 1;
+                    for (uint64_t i=0;i<partial_sizes[t];i++)
+                    {
+                        if (partials[t][i].first % threadnum == tid)
+                            histogram.add(partials[t][i].first, partials[t][i].second);
                     }
-
-
                 }
+                histogram.take_best(g, candidates[tid].first, candidates[tid].second);
 
-                uint64_t bestLabel = 0;
-                uint64_t highest_freq = 0;
-                for ( auto it = histogram.begin(); it != histogram.end(); ++it ) {
-                    uint64_t label = it->first;
-                    uint64_t freq = it->second;
-                    if (freq > highest_freq || (freq == highest_freq && label < bestLabel)) {
-                        bestLabel = label;
-                        highest_freq = freq;
+                #pragma omp barrier
+                if (tid==0)
+                {
+                    uint64_t best = 0;
+                    uint64_t highest_freq = 0;
+                    for (unsigned t=0;t<threadnum;t++)
+                    {
+                        uint64_t freq = candidates[t].second;
+                        if (freq > highest_freq || (freq == highest_freq && histogram.label_less(g, candidates[t].first, best)))
+                        {
+                            best = candidates[t].first;
+                            highest_freq = freq;
+                        }
                     }
+                    g.csr_vertex_property(vid).next_label = best;
+                    active_count++;
                 }
-                vit->property().next_label = bestLabel;
-
-                histogram.clear();
-                global_output_tasks[vertex_distributor(vid,threadnum)+tid*threadnum].push_back(vid);
             }
+            active_counts[tid] = active_count;
 
             #pragma omp barrier
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
-                vit->property().label = vit->property().next_label;
-            }
+            uint64_t changed_count = 0;
+            cdlp_activate activate(*next_active);
+            no_queue none;
+            vertex_map(vertex_num, schedule, [&](uint64_t vid) {
+                uint64_t next_label = g.csr_vertex_property(vid).next_label;
+                if (next_label == g.csr_vertex_property(vid).label)
+                    return;
+                g.csr_vertex_property(vid).label = next_label;
+                changed_count++;
+                if (incremental)
+                    push_edges<ALL_EDGES>(g, vid, activate, none);
+            });
+            changed_counts[tid] = changed_count;
 
             #pragma omp barrier
             if(tid==0) {
                 step++;
 
-                if(step >= iteration) {
+                uint64_t active_total = 0, changed_total = 0;
+                for (unsigned i=0;i<threadnum;i++)
+                {
+                    active_total += active_counts[i];
+                    changed_total += changed_counts[i];
+                }
+                if (incremental)
+                    cout<<"== iteration "<<step<<": "<<active_total<<" vertices recomputed, "
+                        <<changed_total<<" labels changed\n";
+
+                if(step >= iteration || (incremental && changed_total == 0)) {
                     stop = true;
                 }
+                swap(active, next_active);
             }
             #pragma omp barrier
+            if (incremental)
+                next_active->reset(slice_begin, slice_end);
         }
         perf.stop(tid, perf_group);
     }
 }
-#endif
 //==============================================================//
 void output(graph_t& g)
 {
@@ -364,7 +487,21 @@ int main(int argc, char * argv[])
     arg.get_value("dampingfactor", damping_factor);
     arg.get_value("iteration", iteration);
     arg.get_value("threadnum",threadnum);
+    string numa_mode;
+    arg.get_value("numa",numa_mode);
+    if (numa_mode != "interleave" && numa_mode != "none") {
+        cerr << "unknown numa mode: " << numa_mode << endl;
+        return 1;
+    }
     arg.get_value("jobid",jobId);
+    string mode;
+    arg.get_value("mode", mode);
+    uint64_t hub_degree;
+    arg.get_value("hubdegree", hub_degree);
+    if (mode != "incremental" && mode != "full") {
+        cerr << "unknown cdlp mode: " << mode << endl;
+        return 1;
+    }
 
 #ifdef GRANULA
     granula::linkNode(jobId);
@@ -378,18 +515,11 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("StartTime", loadGraph.getEpoch())<<endl;
 #endif
 
+    numa_placement placement(numa_mode, threadnum);
+    placement.before_load();
     t1 = timer::get_usec();
-    string vfile = path + "/vertex.csv";
-    string efile = path + "/edge.csv";
-#ifdef USE_CSR
     if (!graph.load_CSR_Graph(path))
         return -1;
-#else
-    if (!graph.load_csv_vertices(vfile, false, " ", 0))
-        return -1;
-    if (!graph.load_csv_edges(efile, false, " ", 0, 1))
-        return -1;
-#endif
 
     size_t vertex_num = graph.num_vertices();
     size_t edge_num = graph.num_edges();
@@ -409,10 +539,18 @@ int main(int argc, char * argv[])
     double elapse_time = 0;
 
     vector<uint64_t> workset;
-#ifdef USE_CSR
-    gen_workset(graph, workset, threadnum);
+    uint64_t degree_max = max_degree(graph);
+    bool ids_ordered = csr_ids_ordered(threadnum, graph);
+    if (!ids_ordered)
+        cout<<"== internal ids do not follow external id order, comparing external ids\n";
+    vector<uint64_t> hubs;
+    if (hub_degree > 0 && threadnum > 1)
+    {
+        collect_hubs(graph, hub_degree, hubs);
+        cout<<"== "<<hubs.size()<<" hub vertices with degree >= "<<hub_degree<<"\n";
+    }
+    edge_balanced_partition(graph, threadnum, threadnum * partition_chunks_per_thread, 1, workset);
     parallel_init(graph, threadnum, workset);
-#endif
 
 
 #ifdef GRANULA
@@ -423,17 +561,8 @@ int main(int argc, char * argv[])
 
     for (unsigned i=0;i<run_num;i++)
     {
-        queue<vertex_iterator> process_q;
-        vector<vector<uint64_t> > global_input_tasks(threadnum);
-#ifndef USE_CSR
-        parallel_init(graph,threadnum,global_input_tasks);
-#endif
         t1 = timer::get_usec();
-#ifdef USE_CSR
-        parallel_cdlp(graph, iteration, threadnum, workset, perf_multi, i);
-#else        
-        parallel_cdlp(graph, iteration, threadnum, global_input_tasks, perf_multi, i);
-#endif
+        parallel_cdlp(graph, iteration, threadnum, workset, degree_max, ids_ordered, mode == "incremental", hubs, hub_degree, perf_multi, i);
         t2 = timer::get_usec();
         elapse_time += t2-t1;
         if ((i+1)<run_num) reset_graph(graph);
@@ -458,11 +587,7 @@ int main(int argc, char * argv[])
     arg.get_value("output", output_file);
 
     if (!output_file.empty()) {
-#ifdef USE_CSR
         write_csr_graph_vertices(graph, output_file, true);
-#else
-        write_graph_vertices(graph, output_file);
-#endif
     }
 
 #ifdef GRANULA
@@ -0,0 +1,385 @@
+/*
+ * Copyright 2015 Delft University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+#include "omp.h"
+#include "bitmap.hpp"
+#include "sliding_queue.hpp"
+
+// Building blocks shared by the CSR kernels: schedules that split a loop
+// among the threads of a parallel region, push and pull edge maps templated
+// on the per-edge functor so that it inlines, a frontier that switches
+// between a queue and a bitmap, and an edge-balanced vertex partitioner.
+//
+// Everything here is called by all threads of an enclosing
+// `#pragma omp parallel` region. Operators never wait at the end; the
+// kernel places its barriers, as the supersteps of each algorithm differ.
+
+// ---- schedules ----
+//
+// A schedule hands out the indices [0, n) of a loop: run(n, f) calls f(i)
+// for this thread's share.
+
+// dynamic chunks of GRAIN indices, for irregular per-vertex work
+template <unsigned GRAIN>
+class dynamic_schedule
+{
+public:
+    template <typename F>
+    void run(uint64_t n, F f) const
+    {
+        #pragma omp for schedule(dynamic, GRAIN) nowait
+        for (uint64_t i=0;i<n;i++)
+            f(i);
+    }
+};
+
+// Slice [begin, end) of [0, n) for thread tid out of threadnum, cut at
+// multiples of align. With align 64 the slices hold whole bitmap words, so a
+// thread may use the non-atomic bit operations on its own slice.
+inline void aligned_range(uint64_t n, uint64_t align, unsigned tid, unsigned threadnum,
+                          uint64_t &begin, uint64_t &end)
+{
+    uint64_t blocks = (n + align - 1) / align;
+    begin = std::min(n, (blocks * tid / threadnum) * align);
+    end = std::min(n, (blocks * (tid + 1) / threadnum) * align);
+}
+
+// one contiguous slice per thread, cut at bitmap words
+class range_schedule
+{
+public:
+    template <typename F>
+    void run(uint64_t n, F f) const
+    {
+        uint64_t begin, end;
+        aligned_range(n, 64, omp_get_thread_num(), omp_get_num_threads(), begin, end);
+        for (uint64_t i=begin;i<end;i++)
+            f(i);
+    }
+};
+
+// a precomputed static partition: thread tid runs [workset[tid], workset[tid+1])
+template <typename T>
+class workset_schedule
+{
+public:
+    explicit workset_schedule(const std::vector<T> &workset) : _workset(workset) {}
+
+    template <typename F>
+    void run(uint64_t n, F f) const
+    {
+        unsigned tid = omp_get_thread_num();
+        uint64_t begin = std::min(n, (uint64_t) _workset[tid]);
+        uint64_t end = std::min(n, (uint64_t) _workset[tid+1]);
+        for (uint64_t i=begin;i<end;i++)
+            f(i);
+    }
+
+private:
+    const std::vector<T> &_workset;
+};
+
+// chunk c of a partition is [bounds[c], bounds[c+1]); idle threads take the
+// next chunk, so a partition with many more chunks than threads absorbs
+// imbalance the cost model misses
+class chunk_schedule
+{
+public:
+    explicit chunk_schedule(const std::vector<uint64_t> &bounds) : _bounds(bounds) {}
+
+    template <typename F>
+    void run(uint64_t n, F f) const
+    {
+        uint64_t chunks = _bounds.size() - 1;
+        #pragma omp for schedule(dynamic, 1) nowait
+        for (uint64_t c=0;c<chunks;c++)
+        {
+            uint64_t end = std::min(n, _bounds[c+1]);
+            for (uint64_t i=_bounds[c];i<end;i++)
+                f(i);
+        }
+    }
+
+private:
+    const std::vector<uint64_t> &_bounds;
+};
+
+// ---- partitioning ----
+
+// Chunk boundaries are multiples of this many vertices: whole bitmap words,
+// and whole cache lines of any cache-line aligned per-vertex array.
+const uint64_t partition_align = 64;
+
+// chunks per thread for partitions run with chunk_schedule
+const unsigned partition_chunks_per_thread = 16;
+
+// Splits [0, vertex_num) into chunks ranges of about equal cost, where a
+// vertex costs its in- plus out-degree plus vertex_cost. bounds receives
+// chunks + 1 entries; a chunk may be empty when one aligned block outweighs
+// a whole share. Unlike the operators above, this opens its own parallel
+// region: block costs are summed with a parallel prefix sum, then every
+// boundary is found by binary search over the block prefix.
+template <typename G>
+void edge_balanced_partition(G &g, unsigned threadnum, uint64_t chunks, uint64_t vertex_cost,
+                             std::vector<uint64_t> &bounds)
+{
+    uint64_t vertex_num = g.num_vertices();
+    uint64_t blocks = (vertex_num + partition_align - 1) / partition_align;
+    // prefix[b] = cost of the vertices before block b
+    std::vector<uint64_t> prefix(blocks + 1, 0);
+    std::vector<uint64_t> partials(threadnum + 1, 0);
+    bounds.assign(chunks + 1, vertex_num);
+    bounds[0] = 0;
+
+    #pragma omp parallel num_threads(threadnum)
+    {
+        unsigned tid = omp_get_thread_num();
+        uint64_t block_begin = blocks * tid / threadnum;
+        uint64_t block_end = blocks * (tid + 1) / threadnum;
+
+        uint64_t sum = 0;
+        for (uint64_t b=block_begin;b<block_end;b++)
+        {
+            uint64_t end = std::min(vertex_num, (b + 1) * partition_align);
+            for (uint64_t vid=b*partition_align;vid<end;vid++)
+                sum += g.csr_in_edges_size(vid) + g.csr_out_edges_size(vid) + vertex_cost;
+            prefix[b+1] = sum;
+        }
+        partials[tid+1] = sum;
+        #pragma omp barrier
+        #pragma omp single
+        for (unsigned t=0;t<threadnum;t++)
+            partials[t+1] += partials[t];
+        for (uint64_t b=block_begin;b<block_end;b++)
+            prefix[b+1] += partials[tid];
+        #pragma omp barrier
+
+        uint64_t total = prefix[blocks];
+        #pragma omp for
+        for (uint64_t c=1;c<chunks;c++)
+        {
+            // total * c / chunks without overflowing 64 bits
+            uint64_t target = (total / chunks) * c + (total % chunks) * c / chunks;
+            uint64_t b = std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+            bounds[c] = std::min(vertex_num, b * partition_align);
+        }
+    }
+}
+
+// ---- edge maps ----
+
+enum edge_direction
+{
+    OUT_EDGES = 1,
+    IN_EDGES = 2,
+    ALL_EDGES = 3
+};
+
+// sink for push operators whose functor never queues anything
+class no_queue
+{
+public:
+    void push_back(uint64_t) {}
+    void flush(void) {}
+};
+
+// Calls f.edge(src, dst, edges_begin, i) for the DIR edges of src, in-edges
+// first, and appends dst to next whenever it returns true.
+template <edge_direction DIR, typename G, typename F, typename Q>
+inline void push_edges(G &g, uint64_t src, F &f, Q &next)
+{
+    if (DIR & IN_EDGES)
+    {
+        uint64_t edges_begin = g.csr_in_edges_begin(src);
+        uint64_t size = g.csr_in_edges_size(src);
+        for (uint64_t i=0;i<size;i++)
+        {
+            uint64_t dst = g.csr_in_edge(edges_begin, i);
+            if (f.edge(src, dst, edges_begin, i))
+                next.push_back(dst);
+        }
+    }
+    if (DIR & OUT_EDGES)
+    {
+        uint64_t edges_begin = g.csr_out_edges_begin(src);
+        uint64_t size = g.csr_out_edges_size(src);
+        for (uint64_t i=0;i<size;i++)
+        {
+            uint64_t dst = g.csr_out_edge(edges_begin, i);
+            if (f.edge(src, dst, edges_begin, i))
+                next.push_back(dst);
+        }
+    }
+}
+
+// Calls f.edge(dst, src, edges_begin, i) for the DIR edges of dst, in-edges
+// first, until it returns true; returns whether it stopped early.
+template <edge_direction DIR, typename G, typename F>
+inline bool pull_edges(G &g, uint64_t dst, F &f)
+{
+    if (DIR & IN_EDGES)
+    {
+        uint64_t edges_begin = g.csr_in_edges_begin(dst);
+        uint64_t size = g.csr_in_edges_size(dst);
+        for (uint64_t i=0;i<size;i++)
+        {
+            if (f.edge(dst, g.csr_in_edge(edges_begin, i), edges_begin, i))
+                return true;
+        }
+    }
+    if (DIR & OUT_EDGES)
+    {
+        uint64_t edges_begin = g.csr_out_edges_begin(dst);
+        uint64_t size = g.csr_out_edges_size(dst);
+        for (uint64_t i=0;i<size;i++)
+        {
+            if (f.edge(dst, g.csr_out_edge(edges_begin, i), edges_begin, i))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Sparse push over the current window of frontier: every vertex for which
+// f.source(vid) holds pushes along its DIR edges. next is flushed, sliding
+// the frontier is left to the caller.
+template <edge_direction DIR, typename G, typename S, typename F, typename Q>
+void edge_map_push(G &g, const sliding_queue<uint64_t> &frontier, Q &next, const S &schedule, F &f)
+{
+    schedule.run(frontier.size(), [&](uint64_t i) {
+        uint64_t vid = frontier[i];
+        if (f.source(vid))
+            push_edges<DIR>(g, vid, f, next);
+    });
+    next.flush();
+}
+
+// Dense push: every vertex of [0, vertex_num) is a candidate source.
+template <edge_direction DIR, typename G, typename S, typename F, typename Q>
+void edge_map_push(G &g, uint64_t vertex_num, Q &next, const S &schedule, F &f)
+{
+    schedule.run(vertex_num, [&](uint64_t vid) {
+        if (f.source(vid))
+            push_edges<DIR>(g, vid, f, next);
+    });
+    next.flush();
+}
+
+// Pull over [0, vertex_num): every vertex for which f.target(vid) holds scans
+// its DIR edges with f.edge until that returns true, then f.finish(vid) runs.
+template <edge_direction DIR, typename G, typename S, typename F>
+void edge_map_pull(G &g, uint64_t vertex_num, const S &schedule, F &f)
+{
+    schedule.run(vertex_num, [&](uint64_t vid) {
+        if (!f.target(vid))
+            return;
+        pull_edges<DIR>(g, vid, f);
+        f.finish(vid);
+    });
+}
+
+// f(vid) for every vertex of [0, vertex_num)
+template <typename S, typename F>
+void vertex_map(uint64_t vertex_num, const S &schedule, F f)
+{
+    schedule.run(vertex_num, f);
+}
+
+// ---- frontier ----
+
+// Frontier stored either sparse, as the window of a sliding_queue, or dense,
+// as the set bits of current_bits(); next_bits() collects the following
+// dense frontier. The conversions are collective calls.
+class vertex_frontier
+{
+public:
+    explicit vertex_frontier(uint64_t vertex_num)
+        : queue(vertex_num), _vertex_num(vertex_num), _bits_a(vertex_num), _bits_b(vertex_num),
+          _current(&_bits_a), _next(&_bits_b)
+    {
+    }
+
+    sliding_queue<uint64_t> queue;
+
+    bitmap & current_bits(void)
+    {
+        return *_current;
+    }
+
+    bitmap & next_bits(void)
+    {
+        return *_next;
+    }
+
+    // make next_bits() current; one thread, between barriers
+    void swap_bits(void)
+    {
+        std::swap(_current, _next);
+    }
+
+    // this thread's slice of the bitmaps, see aligned_range
+    void thread_range(unsigned tid, unsigned threadnum, uint64_t &begin, uint64_t &end) const
+    {
+        aligned_range(_vertex_num, 64, tid, threadnum, begin, end);
+    }
+
+    // current_bits() = the queue window, which stays in place
+    void to_dense(unsigned tid, unsigned threadnum)
+    {
+        uint64_t begin, end;
+        thread_range(tid, threadnum, begin, end);
+        _current->reset(begin, end);
+        #pragma omp barrier
+        uint64_t queue_size = queue.size();
+        #pragma omp for
+        for (uint64_t i=0;i<queue_size;i++)
+            _current->set_bit_atomic(queue[i]);
+    }
+
+    // the queue window = the set bits of current_bits(), which stay set
+    void to_sparse(queue_buffer<uint64_t> &local_queue, unsigned tid, unsigned threadnum)
+    {
+        uint64_t begin, end;
+        thread_range(tid, threadnum, begin, end);
+        for (uint64_t vid=begin;vid<end;vid++)
+        {
+            if (_current->get_bit(vid))
+                local_queue.push_back(vid);
+        }
+        local_queue.flush();
+        #pragma omp barrier
+        if (tid==0)
+            queue.slide_window();
+        #pragma omp barrier
+    }
+
+private:
+    vertex_frontier(const vertex_frontier &);
+    vertex_frontier & operator=(const vertex_frontier &);
+
+    uint64_t _vertex_num;
+    bitmap _bits_a;
+    bitmap _bits_b;
+    bitmap * _current;
+    bitmap * _next;
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2015 Delft University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+//====== Graph Benchmark Suites ======//
+//======== Sorted-list intersection microbenchmark =======//
+//
+// Times every intersection kernel of intersect.hpp on synthetic pairs of
+// sorted 32-bit and 64-bit lists and marks the kernel intersect_count
+// selects next to the fastest one, to check the INTERSECT_* thresholds.
+//
+// Usage: ./intersect_bench [total elements per measurement]
+
+#include "intersect.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// size strictly increasing values drawn from [base, base + universe)
+template <typename ID>
+vector<ID> sorted_list(size_t size, uint64_t base, uint64_t universe, mt19937_64 &rng)
+{
+    vector<ID> list;
+    while (list.size() < size)
+    {
+        while (list.size() < size)
+            list.push_back(base + rng() % universe);
+        sort(list.begin(), list.end());
+        list.erase(unique(list.begin(), list.end()), list.end());
+    }
+    return list;
+}
+
+template <typename ID>
+size_t run_merge(const ID * a, size_t size_a, const ID * b, size_t size_b)
+{
+    return intersect_merge(a, size_a, b, size_b);
+}
+template <typename ID>
+size_t run_gallop(const ID * a, size_t size_a, const ID * b, size_t size_b)
+{
+    if (size_a > size_b)
+        return intersect_gallop(b, size_b, a, size_a);
+    return intersect_gallop(a, size_a, b, size_b);
+}
+#ifdef INTERSECT_X86
+template <typename ID>
+size_t run_avx2(const ID * a, size_t size_a, const ID * b, size_t size_b)
+{
+    return intersect_avx2(a, size_a, b, size_b);
+}
+template <typename ID>
+size_t run_avx512(const ID * a, size_t size_a, const ID * b, size_t size_b)
+{
+    return intersect_avx512(a, size_a, b, size_b);
+}
+#endif
+template <typename ID>
+size_t run_selected(const ID * a, size_t size_a, const ID * b, size_t size_b)
+{
+    return intersect_count(a, size_a, b, size_b);
+}
+
+template <typename ID>
+class bench_kernel
+{
+public:
+    typedef size_t (*kernel_fn)(const ID *, size_t, const ID *, size_t);
+    bench_kernel(const string &n, kernel_fn f):name(n),fn(f){}
+    string name;
+    kernel_fn fn;
+};
+
+// nanoseconds per intersection, best of three
+template <typename ID>
+double time_kernel(typename bench_kernel<ID>::kernel_fn fn, const vector<vector<ID> > &lists_a,
+                   const vector<vector<ID> > &lists_b, size_t &result)
+{
+    double best = 0;
+    for (int trial=0;trial<3;trial++)
+    {
+        size_t sum = 0;
+        chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+        for (size_t i=0;i<lists_a.size();i++)
+            sum += fn(lists_a[i].data(), lists_a[i].size(), lists_b[i].data(), lists_b[i].size());
+        chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+        double ns = chrono::duration<double, nano>(t2 - t1).count() / lists_a.size();
+        if (trial == 0 || ns < best) best = ns;
+        result = sum;
+    }
+    return best;
+}
+
+// One table for lists of ID. The 64-bit lists start above 2^32, like the ids
+// of the graphs csr_lcc<uint64_t> runs on. Returns false if a kernel
+// miscounts.
+template <typename ID>
+bool bench_width(size_t budget, mt19937_64 &rng)
+{
+    vector<bench_kernel<ID> > kernels;
+    kernels.push_back(bench_kernel<ID>("merge", run_merge<ID>));
+    kernels.push_back(bench_kernel<ID>("gallop", run_gallop<ID>));
+#ifdef INTERSECT_X86
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back(bench_kernel<ID>("avx2", run_avx2<ID>));
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back(bench_kernel<ID>("avx512", run_avx512<ID>));
+#endif
+    kernels.push_back(bench_kernel<ID>("selected", run_selected<ID>));
+
+    const char * kernel_names[] = {"merge", "gallop", "simd"};
+    uint64_t base = (sizeof(ID) > sizeof(uint32_t)) ? 1ULL << 32 : 0;
+    cout<<"== ns per intersection of "<<8*sizeof(ID)<<"-bit lists, universe 4x the long list\n";
+    cout<<setw(8)<<"small"<<setw(8)<<"large";
+    for (size_t k=0;k<kernels.size();k++)
+        cout<<setw(10)<<kernels[k].name;
+    cout<<setw(10)<<"fastest"<<setw(10)<<"picks"<<"\n";
+
+    size_t small_sizes[] = {4, 8, 16, 32, 64, 256, 1024, 4096};
+    size_t ratios[] = {1, 2, 8, 32, 128, 512};
+    for (size_t s=0;s<sizeof(small_sizes)/sizeof(small_sizes[0]);s++)
+    {
+        for (size_t r=0;r<sizeof(ratios)/sizeof(ratios[0]);r++)
+        {
+            size_t size_small = small_sizes[s];
+            size_t size_large = size_small * ratios[r];
+            size_t pairs = max((size_t) 1, budget / (size_small + size_large));
+
+            vector<vector<ID> > lists_a(pairs), lists_b(pairs);
+            for (size_t i=0;i<pairs;i++)
+            {
+                lists_a[i] = sorted_list<ID>(size_small, base, 4 * size_large, rng);
+                lists_b[i] = sorted_list<ID>(size_large, base, 4 * size_large, rng);
+            }
+
+            cout<<setw(8)<<size_small<<setw(8)<<size_large;
+            size_t expected = 0;
+            size_t fastest = 0;
+            double fastest_ns = 0;
+            for (size_t k=0;k<kernels.size();k++)
+            {
+                size_t result;
+                double ns = time_kernel<ID>(kernels[k].fn, lists_a, lists_b, result);
+                if (k == 0)
+                    expected = result;
+                else if (result != expected)
+                {
+                    cerr<<"kernel "<<kernels[k].name<<" counted "<<result<<" instead of "<<expected
+                        <<" on "<<8*sizeof(ID)<<"-bit lists"<<endl;
+                    return false;
+                }
+                cout<<setw(10)<<fixed<<setprecision(1)<<ns;
+                if (kernels[k].name != "selected" && (k == 0 || ns < fastest_ns))
+                {
+                    fastest = k;
+                    fastest_ns = ns;
+                }
+            }
+            cout<<setw(10)<<kernels[fastest].name
+                <<setw(10)<<kernel_names[intersect_select(size_small, size_large)]<<"\n";
+        }
+    }
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    size_t budget = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1 << 22;
+    intersect_simd_level level = intersect_detect_simd();
+
+    cout<<"== gallop ratio "<<INTERSECT_GALLOP_RATIO<<" (merge) / "<<INTERSECT_SIMD_GALLOP_RATIO
+        <<" (simd), simd min size "<<INTERSECT_SIMD_MIN_SIZE
+        <<", simd level "<<(level == INTERSECT_SIMD_AVX512 ? "avx512" : level == INTERSECT_SIMD_AVX2 ? "avx2" : "none")<<"\n";
+
+    mt19937_64 rng(42);
+    if (!bench_width<uint32_t>(budget, rng))
+        return 1;
+    cout<<"\n";
+    if (!bench_width<uint64_t>(budget, rng))
+        return 1;
+    return 0;
+}
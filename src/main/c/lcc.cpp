@@ -23,10 +23,12 @@
 #include "openG.h"
 #include "omp.h"
 #include "util.hpp"
+#include "intersect.hpp"
+#include "engine.hpp"
+#include "numa.hpp"
 #include <set>
 #include <vector>
 #include <algorithm>
-#include <unordered_set>
 #include <unordered_map>
 #include <set>
 #include <iomanip>
@@ -44,12 +46,6 @@ public:
     vertex_property():count(0){}
 
     unsigned long count;
-#ifdef USE_CSR
-    set<uint64_t> unq_set;
-    set<uint64_t> out_set;
-#else
-    unordered_set<uint64_t> unq_set;
-#endif
     double lcc;
 
     friend ostream& operator<< (ostream &strm, const vertex_property &that) {
@@ -78,240 +74,578 @@ typedef graph_t::edge_iterator      edge_iterator;
 void arg_init(argument_parser & arg)
 {
     arg.add_arg("jobid","UniqueJob","id of the openg job.");
+    arg.add_arg("numa","interleave","memory placement on multi-socket machines: interleave (spread all pages over the nodes) or none");
     arg.add_arg("output", "", "Absolute path to the file where the output will be stored");
+    arg.add_arg("mode","triangle","lcc kernel: triangle (enumerate each triangle once over degree-oriented edges) or neighbor (intersect each neighbour's out-list)");
+    arg.add_arg("hubdegree","8192","neighbor mode: vertices with at least this many neighbours are processed by all threads together; 0 disables");
+    arg.add_arg("markdegree","64","vertices with at least this many (triangle mode: oriented) neighbours mark them in a bitmap or hash set and probe instead of merging");
 }
 //==============================================================//
-size_t get_intersect_cnt(unordered_set<uint64_t> & setA, vertex_iterator & vit_targ)
+// Deduplicated, sorted neighbour lists in CSR form: for each vertex the
+// union of its in- and out-neighbours, and separately its out-neighbours.
+// ID is uint32_t whenever the vertex ids fit, halving the footprint.
+template <typename ID>
+class neighbor_lists
 {
-    unordered_set<uint64_t> setC;
-    setC.clear();
-
-    for ( auto it1 = setA.begin(); it1 != setA.end(); ++it1 ) {
-
-                    for (edge_iterator eit=vit_targ->edges_begin();eit!=vit_targ->edges_end();eit++)
-                    {
-                                if(*it1 == eit->target()) {
-                                    setC.insert(eit->target());
-                                }
-                    }
+public:
+    const ID * unq(uint64_t vid) const { return &_unq_adj[_unq_begin[vid]]; }
+    uint64_t unq_size(uint64_t vid) const { return _unq_begin[vid+1] - _unq_begin[vid]; }
+    const ID * out(uint64_t vid) const { return &_out_adj[_out_begin[vid]]; }
+    uint64_t out_size(uint64_t vid) const { return _out_begin[vid+1] - _out_begin[vid]; }
+
+    // two passes over the graph, so that no more than the final arrays are
+    // ever allocated: the first sizes each list, the second fills it
+    void build(graph_t &g, unsigned threadnum, vector<uint64_t> &workset)
+    {
+        uint64_t vertex_num = g.num_vertices();
+        _unq_begin.assign(vertex_num + 1, 0);
+        _out_begin.assign(vertex_num + 1, 0);
 
+        fill(g, threadnum, workset, false);
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            _unq_begin[vid+1] += _unq_begin[vid];
+            _out_begin[vid+1] += _out_begin[vid];
+        }
+        _unq_adj.resize(_unq_begin[vertex_num]);
+        _out_adj.resize(_out_begin[vertex_num]);
+        fill(g, threadnum, workset, true);
     }
-    return setC.size();
-}
-#ifdef USE_CSR
-size_t get_intersect_cnt(set<uint64_t>& setA, set<uint64_t>& setB)
-{
-    size_t ret=0;
-    set<uint64_t>::iterator iter1=setA.begin(), iter2=setB.begin();
 
-    while (iter1!=setA.end() && iter2!=setB.end()) 
+    size_t footprint(void) const
     {
-        if ((*iter1) < (*iter2)) 
-            iter1++;
-        else if ((*iter1) > (*iter2)) 
-            iter2++;
-        else
-        {
-            ret++;
-            iter1++;
-            iter2++;
-        }
+        return sizeof(uint64_t) * (_unq_begin.size() + _out_begin.size())
+            + sizeof(ID) * (_unq_adj.size() + _out_adj.size());
     }
 
-    return ret;
-}
-void gen_workset(graph_t& g, vector<unsigned>& workset, unsigned threadnum)
-{
-    unsigned chunk = (unsigned)ceil(g.num_edges()/(double)threadnum);
-    unsigned last=0, curr=0, th=1;
-    workset.clear();
-    workset.resize(threadnum+1,0);
-    for (uint64_t vid=0;vid<g.vertex_num();vid++)
+    // what the same lists took as two std::set<uint64_t> per vertex
+    size_t set_footprint(void) const
     {
-        curr += g.csr_out_edges_size(vid);
+        return 2 * sizeof(set<uint64_t>) * (_unq_begin.size() - 1)
+            + set_node_size * (_unq_adj.size() + _out_adj.size());
+    }
 
-        if ((curr-last)>=chunk)
+private:
+    // red-black tree node holding a uint64_t: padded colour, three links and the value
+    static const size_t set_node_size = 4 * sizeof(void *) + sizeof(uint64_t);
+
+    void fill(graph_t &g, unsigned threadnum, vector<uint64_t> &workset, bool write)
+    {
+        #pragma omp parallel num_threads(threadnum)
         {
-            last = curr;
-            workset[th] = vid;
-            if (th<threadnum) th++;
+            vector<ID> scratch;
+
+            vertex_map(g.num_vertices(), chunk_schedule(workset), [&](uint64_t vid) {
+                uint64_t out_size = g.csr_out_edges_size(vid);
+                uint64_t out_begin = g.csr_out_edges_begin(vid);
+                uint64_t in_size = g.csr_in_edges_size(vid);
+                uint64_t in_begin = g.csr_in_edges_begin(vid);
+
+                scratch.clear();
+                for (uint64_t i=0;i<out_size;i++)
+                    scratch.push_back(g.csr_out_edge(out_begin,i));
+                sort(scratch.begin(), scratch.end());
+                uint64_t size = unique(scratch.begin(), scratch.end()) - scratch.begin();
+                if (write)
+                    copy(scratch.begin(), scratch.begin() + size, _out_adj.begin() + _out_begin[vid]);
+                else
+                    _out_begin[vid+1] = size;
+
+                for (uint64_t i=0;i<in_size;i++)
+                    scratch.push_back(g.csr_in_edge(in_begin,i));
+                sort(scratch.begin(), scratch.end());
+                size = unique(scratch.begin(), scratch.end()) - scratch.begin();
+                if (write)
+                    copy(scratch.begin(), scratch.begin() + size, _unq_adj.begin() + _unq_begin[vid]);
+                else
+                    _unq_begin[vid+1] = size;
+            });
         }
     }
-    workset[threadnum] = g.num_vertices();
-    for (unsigned i=threadnum-1;i>=1;i--)
+
+    vector<uint64_t> _unq_begin;
+    vector<ID> _unq_adj;
+    vector<uint64_t> _out_begin;
+    vector<ID> _out_adj;
+};
+
+template <typename ID>
+const size_t neighbor_lists<ID>::set_node_size;
+
+// vertices with at least hub_degree distinct neighbours
+template <typename ID>
+void collect_hubs(const neighbor_lists<ID> &lists, uint64_t vertex_num, uint64_t hub_degree, vector<uint64_t> &hubs)
+{
+    hubs.clear();
+    for (uint64_t vid=0;vid<vertex_num;vid++)
     {
-        if (workset[i]==0)
-            workset[i]=workset[i+1];
+        if (lists.unq_size(vid) >= hub_degree)
+            hubs.push_back(vid);
     }
 }
 
-void parallel_lcc_init(graph_t &g, unsigned threadnum,
-        vector<unsigned> &workset)
+// Per-thread set of marked vertex ids with a 2-bit value each, so that the
+// neighbour list of a high-degree vertex can be marked once and the lists of
+// its neighbours probed against it in linear time instead of being merged.
+// Lists whose ids span a range much wider than their length go into a small
+// open-addressing table instead of the dense array. Both are cleared by
+// walking what was marked.
+template <typename ID>
+class neighbor_marks
 {
+public:
+    // a list goes into the hash table if its id span exceeds this many ids per element
+    static const uint64_t dense_span_factor = 256;
 
-    #pragma omp parallel num_threads(threadnum)
+    neighbor_marks(uint64_t vertex_num, uint64_t max_degree)
+        : _dense((vertex_num + 31) / 32, 0), _list(NULL), _size(0), _hashed(false)
     {
-        unsigned tid = omp_get_thread_num();
-        unsigned start = workset[tid];
-        unsigned end = workset[tid+1];
-        if (end > g.num_vertices()) end = g.num_vertices();
+        uint64_t capacity = 64;
+        while (capacity < 2 * max_degree) capacity *= 2;
+        _mask = capacity - 1;
+        _keys.resize(capacity, empty_key);
+        _values.resize(capacity, 0);
+    }
 
-        // prepare neighbor set for each vertex
-        for (uint64_t vid=start;vid<end;vid++)
+    // mark list[0..size) with values[i], or with 1 if values is NULL;
+    // values must be 1, 2 or 3 and the list sorted
+    void mark(const ID * list, const uint8_t * values, uint64_t size)
+    {
+        _list = list;
+        _size = size;
+        _hashed = size > 0 && list[size-1] - list[0] > dense_span_factor * size;
+        for (uint64_t i=0;i<size;i++)
         {
-            g.csr_vertex_property(vid).count = 0;
-
-            set<uint64_t>& cur_set = g.csr_vertex_property(vid).unq_set;
-            set<uint64_t>& out_set = g.csr_vertex_property(vid).out_set;
-
-            uint64_t size = g.csr_out_edges_size(vid);
-            uint64_t begin = g.csr_out_edges_begin(vid);
-            for (uint64_t i=0;i<size;i++)
+            uint64_t value = values ? values[i] : 1;
+            if (_hashed)
             {
-                cur_set.insert(g.csr_out_edge(begin,i));
-                out_set.insert(g.csr_out_edge(begin,i));
+                uint64_t slot = hash(list[i]);
+                while (_keys[slot] != empty_key) slot = (slot + 1) & _mask;
+                _keys[slot] = list[i];
+                _values[slot] = value;
             }
-            size = g.csr_in_edges_size(vid);
-            begin = g.csr_in_edges_begin(vid);
-            for (uint64_t i=0;i<size;i++)
+            else
+                _dense[list[i] / 32] |= value << (list[i] % 32 * 2);
+        }
+    }
+
+    // value the id was marked with, 0 if it is not marked
+    uint8_t get(ID id) const
+    {
+        if (!_hashed)
+            return (_dense[id / 32] >> (id % 32 * 2)) & 3;
+
+        uint64_t slot = hash(id);
+        while (_keys[slot] != empty_key)
+        {
+            if (_keys[slot] == id)
+                return _values[slot];
+            slot = (slot + 1) & _mask;
+        }
+        return 0;
+    }
+
+    void clear(void)
+    {
+        for (uint64_t i=0;i<_size;i++)
+        {
+            if (_hashed)
             {
-                cur_set.insert(g.csr_in_edge(begin,i));
+                // every marked key is removed, so probe chains may be cut freely
+                uint64_t slot = hash(_list[i]);
+                while (_keys[slot] != _list[i]) slot = (slot + 1) & _mask;
+                _keys[slot] = empty_key;
             }
+            else
+                _dense[_list[i] / 32] = 0;
+        }
+        _size = 0;
+    }
+
+private:
+    static const ID empty_key = (ID) -1;
+
+    uint64_t hash(uint64_t id) const
+    {
+        return (id * 0x9E3779B97F4A7C15ULL >> 32) & _mask;
+    }
+
+    vector<uint64_t> _dense;
+    vector<ID> _keys;
+    vector<uint8_t> _values;
+    uint64_t _mask;
+    const ID * _list;
+    uint64_t _size;
+    bool _hashed;
+};
 
+template <typename ID>
+const uint64_t neighbor_marks<ID>::dense_span_factor;
+template <typename ID>
+const ID neighbor_marks<ID>::empty_key;
+
+// number of edges among the neighbours of vid, counted over the neighbours
+// with index i in [begin, end) stepping by stride; with marks, the neighbour
+// list of vid is marked once and every out-list that is not longer than it
+// is probed against the marks instead of intersected
+template <typename ID>
+size_t neighbor_edges(const neighbor_lists<ID> &lists, uint64_t vid, uint64_t begin, uint64_t end, uint64_t stride,
+                      neighbor_marks<ID> * marks)
+{
+    const ID * unq = lists.unq(vid);
+    uint64_t unq_size = lists.unq_size(vid);
+    size_t cnt = 0;
+    if (marks)
+        marks->mark(unq, NULL, unq_size);
+    for (uint64_t i=begin;i<end;i+=stride)
+    {
+        uint64_t dest_vid = unq[i];
+        const ID * out = lists.out(dest_vid);
+        uint64_t out_size = lists.out_size(dest_vid);
+        if (marks && out_size <= unq_size)
+        {
+            for (uint64_t j=0;j<out_size;j++)
+                cnt += (marks->get(out[j]) != 0);
         }
+        else
+            cnt += intersect_count(unq, unq_size, out, out_size);
     }
+    if (marks)
+        marks->clear();
+    return cnt;
 }
 
+inline double lcc_value(size_t count, size_t degree)
+{
+    if (degree < 2)
+        return 0;
+    return (double) count / (degree * (degree - 1));
+}
 
-void parallel_lcc(graph_t &g, unsigned threadnum, vector<unsigned> &workset,
+// Hub vertices are skipped by the thread that takes their chunk. Afterwards
+// every thread takes every threadnum-th neighbour of each hub, so the
+// intersections of one hub are spread over all threads.
+template <typename ID>
+void parallel_lcc(graph_t &g, const neighbor_lists<ID> &lists, unsigned threadnum, vector<uint64_t> &workset,
+                  vector<uint64_t> &hubs, uint64_t hub_degree, uint64_t mark_degree, uint64_t max_degree,
                   gBenchPerf_multi &perf, int perf_group)
 {
 
     #pragma omp parallel num_threads(threadnum)
     {
         unsigned tid = omp_get_thread_num();
+        neighbor_marks<ID> marks(g.num_vertices(), max_degree);
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        unsigned start = workset[tid];
-        unsigned end = workset[tid+1];
-        if (end > g.num_vertices()) end = g.num_vertices();
 
         // run lcc now
-        for (uint64_t vid=start;vid<end;vid++)
+        vertex_map(g.num_vertices(), chunk_schedule(workset), [&](uint64_t vid) {
+            uint64_t degree = lists.unq_size(vid);
+            if (!hubs.empty() && degree >= hub_degree)
+                return;
+
+            g.csr_vertex_property(vid).count = neighbor_edges(lists, vid, 0, degree, 1,
+                                                              degree >= mark_degree ? &marks : NULL);
+            g.csr_vertex_property(vid).lcc = lcc_value(g.csr_vertex_property(vid).count, degree);
+        });
+
+        #pragma omp for
+        for (size_t h=0;h<hubs.size();h++)
         {
-            for (auto it = g.csr_vertex_property(vid).unq_set.begin(); it != g.csr_vertex_property(vid).unq_set.end(); ++it)
-            {
-                uint64_t dest_vid = *it;
-                size_t cnt = get_intersect_cnt(g.csr_vertex_property(vid).unq_set, g.csr_vertex_property(dest_vid).out_set);
-                __sync_fetch_and_add(&(g.csr_vertex_property(vid).count), cnt);
-            }
+            g.csr_vertex_property(hubs[h]).count = 0;
+        }
 
-            size_t degree = g.csr_vertex_property(vid).unq_set.size();
-            g.csr_vertex_property(vid).lcc = 0;
-            if(degree >= 2) {
-                g.csr_vertex_property(vid).lcc = (double) g.csr_vertex_property(vid).count / (degree * (degree - 1));
-            }
+        for (size_t h=0;h<hubs.size();h++)
+        {
+            uint64_t vid = hubs[h];
+            size_t cnt = neighbor_edges(lists, vid, tid, lists.unq_size(vid), threadnum,
+                                        lists.unq_size(vid) >= mark_degree ? &marks : NULL);
+            __sync_fetch_and_add(&(g.csr_vertex_property(vid).count), cnt);
         }
         #pragma omp barrier
+
+        #pragma omp for
+        for (size_t h=0;h<hubs.size();h++)
+        {
+            uint64_t vid = hubs[h];
+            g.csr_vertex_property(vid).lcc = lcc_value(g.csr_vertex_property(vid).count, lists.unq_size(vid));
+        }
         perf.stop(tid, perf_group);
     }
 
 }
 
-#else
-void gen_workset(graph_t& g, vector<unsigned>& workset, unsigned threadnum)
+// Edges of the symmetrized graph, each kept once at the endpoint of lower
+// (degree, id) rank and sorted by id. dir holds bit 0 if the input has the
+// edge in the stored direction and bit 1 if it has the reverse one, so a
+// triangle can be credited with the number of directed edges it spans.
+template <typename ID>
+class oriented_lists
 {
-    unsigned chunk = (unsigned)ceil(g.num_edges()/(double)threadnum);
-    unsigned last=0, curr=0, th=1;
-    workset.clear();
-    workset.resize(threadnum+1,0);
-    for (vertex_iterator vit=g.vertices_begin(); vit!=g.vertices_end(); vit++)
-    {
-        curr += vit->edges_size();
-        if ((curr-last)>=chunk)
-        {
-            last = curr;
-            workset[th] = vit->id();
-            if (th<threadnum) th++;
-        }
-    }
-    workset[threadnum] = g.num_vertices();
-    for (unsigned i=threadnum-1;i>=1;i--)
+public:
+    const ID * fwd(uint64_t vid) const { return &_adj[_begin[vid]]; }
+    const uint8_t * dir(uint64_t vid) const { return &_dir[_begin[vid]]; }
+    uint64_t fwd_size(uint64_t vid) const { return _begin[vid+1] - _begin[vid]; }
+
+    size_t footprint(void) const
     {
-        if (workset[i]==0)
-            workset[i]=workset[i+1];
+        return sizeof(uint64_t) * _begin.size() + (sizeof(ID) + sizeof(uint8_t)) * _adj.size();
     }
-}
 
-void parallel_lcc_init(graph_t &g, unsigned threadnum)
-{
-    vector<unsigned> ws;
-    gen_workset(g, ws, threadnum);
-
-    #pragma omp parallel num_threads(threadnum)
+    // returns false if the graph has self-loops, which the triangle
+    // enumeration cannot credit the way the neighbour intersection does
+    bool build(const neighbor_lists<ID> &lists, uint64_t vertex_num, unsigned threadnum)
     {
-        unsigned tid = omp_get_thread_num();
+        _begin.assign(vertex_num + 1, 0);
+        uint64_t self_loops = 0;
 
-        // prepare neighbor set for each vertex
-        for (uint64_t vid=ws[tid];vid<ws[tid+1];vid++)
+        #pragma omp parallel for num_threads(threadnum) schedule(dynamic, 1024) reduction(+:self_loops)
+        for (uint64_t vid=0;vid<vertex_num;vid++)
         {
-            vertex_iterator vit = g.find_vertex(vid);
-            if (vit == g.vertices_end()) continue;
-
-            vit->property().count = 0;
-
-            unordered_set<uint64_t>& cur_set = vit->property().unq_set;
-            cur_set.reserve(vit->in_edges_size() + vit->out_edges_size());
-            for (edge_iterator eit=vit->in_edges_begin();eit!=vit->in_edges_end();eit++)
+            const ID * unq = lists.unq(vid);
+            uint64_t size = 0;
+            for (uint64_t i=0;i<lists.unq_size(vid);i++)
             {
-                cur_set.insert(eit->target());
+                if (unq[i] == vid)
+                    self_loops++;
+                else if (ranks_higher(lists, unq[i], vid))
+                    size++;
             }
-            for (edge_iterator eit=vit->out_edges_begin();eit!=vit->out_edges_end();eit++)
+            _begin[vid+1] = size;
+        }
+        if (self_loops > 0)
+            return false;
+
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+            _begin[vid+1] += _begin[vid];
+        _adj.resize(_begin[vertex_num]);
+        _dir.resize(_begin[vertex_num]);
+
+        #pragma omp parallel for num_threads(threadnum) schedule(dynamic, 1024)
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            const ID * unq = lists.unq(vid);
+            const ID * out = lists.out(vid);
+            uint64_t out_size = lists.out_size(vid);
+            uint64_t pos = _begin[vid];
+            uint64_t j = 0;
+            for (uint64_t i=0;i<lists.unq_size(vid);i++)
             {
-                cur_set.insert(eit->target());
+                uint64_t dest_vid = unq[i];
+                while (j < out_size && out[j] < dest_vid) j++;
+                if (!ranks_higher(lists, dest_vid, vid))
+                    continue;
+
+                const ID * dest_out = lists.out(dest_vid);
+                bool forward = (j < out_size && out[j] == dest_vid);
+                bool backward = binary_search(dest_out, dest_out + lists.out_size(dest_vid), (ID) vid);
+                _adj[pos] = dest_vid;
+                _dir[pos] = (forward ? 1 : 0) | (backward ? 2 : 0);
+                pos++;
             }
         }
+        return true;
+    }
+
+private:
+    static bool ranks_higher(const neighbor_lists<ID> &lists, uint64_t u, uint64_t v)
+    {
+        uint64_t degree_u = lists.unq_size(u), degree_v = lists.unq_size(v);
+        return degree_u > degree_v || (degree_u == degree_v && u > v);
     }
-}
 
+    vector<uint64_t> _begin;
+    vector<ID> _adj;
+    vector<uint8_t> _dir;
+};
 
-void parallel_lcc(graph_t &g, unsigned threadnum, vector<unsigned> &workset,
-                  gBenchPerf_multi &perf, int perf_group)
+inline uint64_t edge_count(uint8_t dir)
 {
+    return (dir & 1) + (dir >> 1);
+}
+
+// Every triangle a < b < c in rank order is found once, at a, by merging
+// fwd(a) with fwd(b). Each corner is credited with the directed edges between
+// the other two, which sums to the same count as the neighbour intersection.
+// The credits of a and b are summed in registers and added once per a and
+// per (a, b). Corner c ranks highest, so on skewed graphs it is mostly a hub:
+// vertices with at least mark_degree neighbours (numbered from 1 in hub_slot,
+// 0 for the others) are credited in per-thread counters added up at the end,
+// and the few triangles on other c go to the shared count directly.
+//
+// If fwd(a) has at least mark_degree entries, it is marked with its edge
+// directions once and every fwd(b) is probed against the marks instead.
+template <typename ID>
+void parallel_lcc_triangles(graph_t &g, const neighbor_lists<ID> &lists, const oriented_lists<ID> &oriented,
+                            unsigned threadnum, const vector<uint64_t> &hubs, const vector<ID> &hub_slot,
+                            vector<vector<uint64_t> > &hub_counts,
+                            uint64_t mark_degree, uint64_t max_degree,
+                            gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    uint64_t hub_num = hubs.size();
 
     #pragma omp parallel num_threads(threadnum)
     {
         unsigned tid = omp_get_thread_num();
+        neighbor_marks<ID> marks(vertex_num, max_degree);
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        unsigned start = workset[tid];
-        unsigned end = workset[tid+1];
-        if (end > g.num_vertices()) end = g.num_vertices();
+        uint64_t * hub_count = hub_counts[tid].data();
+        fill(hub_count, hub_count + hub_num, 0);
+        auto credit_c = [&](uint64_t c, uint64_t edges) {
+            ID slot = hub_slot[c];
+            if (slot != 0)
+                hub_count[slot - 1] += edges;
+            else
+                __sync_fetch_and_add(&(g.csr_vertex_property(c).count), edges);
+        };
+
+        #pragma omp for
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+            g.csr_vertex_property(vid).count = 0;
 
-        // run lcc now
-        for (uint64_t vid=start;vid<end;vid++)
+        #pragma omp for schedule(dynamic, 64)
+        for (uint64_t a=0;a<vertex_num;a++)
         {
-            vertex_iterator vit = g.find_vertex(vid);
-            for (auto it = vit->property().unq_set.begin(); it != vit->property().unq_set.end(); ++it) {
-               vertex_iterator vit_targ = g.find_vertex(*it);
-                size_t cnt = get_intersect_cnt(vit->property().unq_set, vit_targ);
-                __sync_fetch_and_add(&(vit->property().count), cnt);
+            const ID * fwd_a = oriented.fwd(a);
+            const uint8_t * dir_a = oriented.dir(a);
+            uint64_t size_a = oriented.fwd_size(a);
+            bool marked = size_a >= mark_degree;
+            if (marked)
+                marks.mark(fwd_a, dir_a, size_a);
+
+            uint64_t count_a = 0;
+            for (uint64_t k=0;k<size_a;k++)
+            {
+                uint64_t b = fwd_a[k];
+                uint64_t edges_ab = edge_count(dir_a[k]);
+                const ID * fwd_b = oriented.fwd(b);
+                const uint8_t * dir_b = oriented.dir(b);
+                uint64_t size_b = oriented.fwd_size(b);
+                uint64_t count_b = 0;
+
+                if (marked)
+                {
+                    for (uint64_t j=0;j<size_b;j++)
+                    {
+                        uint8_t dir_ac = marks.get(fwd_b[j]);
+                        if (dir_ac == 0)
+                            continue;
+                        count_a += edge_count(dir_b[j]);
+                        count_b += edge_count(dir_ac);
+                        credit_c(fwd_b[j], edges_ab);
+                    }
+                }
+                else
+                {
+                    intersect_merge_each(fwd_a, size_a, fwd_b, size_b, [&](size_t i, size_t j) {
+                        count_a += edge_count(dir_b[j]);
+                        count_b += edge_count(dir_a[i]);
+                        credit_c(fwd_a[i], edges_ab);
+                    });
+                }
+                if (count_b > 0)
+                    __sync_fetch_and_add(&(g.csr_vertex_property(b).count), count_b);
             }
+            if (count_a > 0)
+                __sync_fetch_and_add(&(g.csr_vertex_property(a).count), count_a);
+            if (marked)
+                marks.clear();
+        }
 
-            int degree = vit->property().unq_set.size();
-            vit->property().lcc = 0;
-            if(degree >= 2) {
-                vit->property().lcc = (double) vit->property().count / (degree * (degree - 1));
-            }
+        #pragma omp for
+        for (uint64_t h=0;h<hub_num;h++)
+        {
+            uint64_t sum = 0;
+            for (unsigned t=0;t<threadnum;t++)
+                sum += hub_counts[t][h];
+            g.csr_vertex_property(hubs[h]).count += sum;
+        }
+
+        #pragma omp for
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            g.csr_vertex_property(vid).lcc = lcc_value(g.csr_vertex_property(vid).count, lists.unq_size(vid));
         }
-        #pragma omp barrier
         perf.stop(tid, perf_group);
     }
-
 }
-#endif
+
+// LCC state for one vertex id width: the neighbour lists plus the hub list,
+// and for the triangle engine the oriented lists and per-thread hub counters.
+template <typename ID>
+class csr_lcc
+{
+public:
+    void init(graph_t &g, unsigned threadnum, const vector<uint64_t> &workset,
+              bool triangles, uint64_t hub_degree, uint64_t mark_degree)
+    {
+        uint64_t vertex_num = g.num_vertices();
+        _threadnum = threadnum;
+        _workset = workset;
+        _hub_degree = hub_degree;
+        _mark_degree = mark_degree;
+
+        _lists.build(g, threadnum, _workset);
+        cout<<"== neighbour lists: "<<_lists.footprint()/(1024.0*1024.0)<<" MB as sorted "<<8*sizeof(ID)
+            <<"-bit arrays, "<<_lists.set_footprint()/(1024.0*1024.0)<<" MB as std::set\n";
+
+        _max_degree = 0;
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+            _max_degree = max(_max_degree, _lists.unq_size(vid));
+
+        _triangles = triangles;
+        if (_triangles && !_oriented.build(_lists, vertex_num, threadnum))
+        {
+            cout<<"== graph has self-loops, using neighbour intersection instead of triangles\n";
+            _triangles = false;
+        }
+
+        if (_triangles)
+        {
+            collect_hubs(_lists, vertex_num, mark_degree, _hubs);
+            _hub_slot.assign(vertex_num, 0);
+            for (uint64_t h=0;h<_hubs.size();h++)
+                _hub_slot[_hubs[h]] = h + 1;
+            _hub_counts.assign(threadnum, vector<uint64_t>(_hubs.size()));
+            cout<<"== oriented lists: "<<_oriented.footprint()/(1024.0*1024.0)<<" MB, per-thread counters for "
+                <<_hubs.size()<<" vertices with degree >= "<<mark_degree<<"\n";
+        }
+        else if (hub_degree > 0 && threadnum > 1)
+        {
+            collect_hubs(_lists, vertex_num, hub_degree, _hubs);
+            cout<<"== "<<_hubs.size()<<" hub vertices with degree >= "<<hub_degree<<"\n";
+        }
+    }
+
+    void run(graph_t &g, gBenchPerf_multi &perf, int perf_group)
+    {
+        if (_triangles)
+            parallel_lcc_triangles(g, _lists, _oriented, _threadnum, _hubs, _hub_slot, _hub_counts,
+                                   _mark_degree, _max_degree,
+                                   perf, perf_group);
+        else
+            parallel_lcc(g, _lists, _threadnum, _workset, _hubs, _hub_degree, _mark_degree, _max_degree,
+                         perf, perf_group);
+    }
+
+private:
+    unsigned _threadnum;
+    vector<uint64_t> _workset;
+    bool _triangles;
+    uint64_t _hub_degree;
+    uint64_t _mark_degree;
+    uint64_t _max_degree;
+    neighbor_lists<ID> _lists;
+    oriented_lists<ID> _oriented;
+    vector<uint64_t> _hubs;
+    vector<ID> _hub_slot;
+    vector<vector<uint64_t> > _hub_counts;
+};
+
 void output(graph_t& g)
 {
     cout<<"LCC Results: \n";
@@ -370,6 +704,22 @@ int main(int argc, char * argv[])
 
     size_t threadnum;
     arg.get_value("threadnum",threadnum);
+    string numa_mode;
+    arg.get_value("numa",numa_mode);
+    if (numa_mode != "interleave" && numa_mode != "none") {
+        cerr << "unknown numa mode: " << numa_mode << endl;
+        return 1;
+    }
+    uint64_t hub_degree;
+    arg.get_value("hubdegree", hub_degree);
+    uint64_t mark_degree;
+    arg.get_value("markdegree", mark_degree);
+    string mode;
+    arg.get_value("mode", mode);
+    if (mode != "triangle" && mode != "neighbor") {
+        cerr << "unknown lcc mode: " << mode << endl;
+        return 1;
+    }
 
     double t1, t2;
     graph_t graph;
@@ -380,18 +730,11 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("StartTime", loadGraph.getEpoch())<<endl;
 #endif
 
+    numa_placement placement(numa_mode, threadnum);
+    placement.before_load();
     t1 = timer::get_usec();
-    string vfile = path + "/vertex.csv";
-    string efile = path + "/edge.csv";
-#ifdef USE_CSR
     if (!graph.load_CSR_Graph(path))
         return -1;
-#else
-    if (!graph.load_csv_vertices(vfile, false, " ", 0))
-        return -1;
-    if (!graph.load_csv_edges(efile, false, " ", 0, 1))
-        return -1;
-#endif
 
     uint64_t vertex_num = graph.num_vertices();
     uint64_t edge_num = graph.num_edges();
@@ -404,14 +747,16 @@ int main(int argc, char * argv[])
 #endif
 
     cout<<"\ninitializing lcc"<<endl;
-    vector<unsigned> workset;
-#ifdef USE_CSR
-    gen_workset(graph, workset, threadnum);
-    parallel_lcc_init(graph, threadnum, workset);
-#else
-    parallel_lcc_init(graph, threadnum);
-    gen_workset(graph, workset, threadnum);
-#endif
+    vector<uint64_t> workset;
+    edge_balanced_partition(graph, threadnum, threadnum * partition_chunks_per_thread, 1, workset);
+
+    bool narrow_ids = vertex_num <= numeric_limits<uint32_t>::max();
+    csr_lcc<uint32_t> lcc32;
+    csr_lcc<uint64_t> lcc64;
+    if (narrow_ids)
+        lcc32.init(graph, threadnum, workset, mode == "triangle", hub_degree, mark_degree);
+    else
+        lcc64.init(graph, threadnum, workset, mode == "triangle", hub_degree, mark_degree);
     cout<<"\ncomputing lcc..."<<endl;
 
     gBenchPerf_multi perf_multi(threadnum, perf);
@@ -428,7 +773,10 @@ int main(int argc, char * argv[])
     for (unsigned i=0;i<run_num;i++)
     {
         t1 = timer::get_usec();
-        parallel_lcc(graph, threadnum, workset, perf_multi, i);
+        if (narrow_ids)
+            lcc32.run(graph, perf_multi, i);
+        else
+            lcc64.run(graph, perf_multi, i);
         t2 = timer::get_usec();
 
         elapse_time += t2 - t1;
@@ -454,11 +802,7 @@ int main(int argc, char * argv[])
     arg.get_value("output", output_file);
 
     if (!output_file.empty()) {
-#ifdef USE_CSR
         write_csr_graph_vertices(graph, output_file);
-#else
-        write_graph_vertices(graph, output_file);
-#endif
     }
 
 #ifdef GRANULA
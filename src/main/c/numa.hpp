@@ -0,0 +1,248 @@
+/*
+ * Copyright 2015 Delft University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "omp.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <cstring>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+// Memory placement across NUMA nodes, through the raw set_mempolicy and
+// sched_setaffinity system calls so that no libnuma is needed. Modes:
+//
+// - interleave: every allocation of the process, from graph loading on, is
+//   spread page by page over all nodes, so no node serves all the threads.
+// - partition: the graph is loaded interleaved, since openG allocates and
+//   fills its CSR and property arrays itself. after_load then pins thread tid
+//   to node tid * nodes / threadnum and drops the interleaving, so arrays the
+//   kernel allocates untouched (first_touch_allocator) and fills under a
+//   static per-thread slicing land on the node of the thread that works on
+//   each slice. Only kernels with such slices (PageRank) accept this mode.
+// - none: the default first-touch policy.
+//
+// Modes are validated by the callers. With one node, one thread or no Linux
+// NUMA support all calls do nothing.
+class numa_placement
+{
+public:
+    numa_placement(const std::string &mode, unsigned threadnum)
+        : _mode(NONE), _threadnum(threadnum)
+    {
+        if (mode == "interleave")
+            _mode = INTERLEAVE;
+        else if (mode == "partition")
+            _mode = PARTITION;
+        if (_mode == NONE)
+            return;
+
+        detect_nodes();
+        if (_nodes.size() < 2 || threadnum < 2)
+        {
+            std::cout << "== numa: " << _nodes.size() << " node(s), " << threadnum
+                      << " thread(s), placement skipped\n";
+            _mode = NONE;
+        }
+    }
+
+    // call before the graph is loaded
+    void before_load(void)
+    {
+        if (_mode == NONE)
+            return;
+        set_policy(MPOL_INTERLEAVE);
+        if (_mode == INTERLEAVE)
+            std::cout << "== numa: " << _nodes.size() << " nodes, interleaved\n";
+    }
+
+    // call once the graph is loaded, before the kernel allocates its arrays
+    void after_load(void)
+    {
+        if (_mode != PARTITION)
+            return;
+        set_policy(MPOL_DEFAULT);
+        pin_threads();
+        std::cout << "== numa: " << _nodes.size() << " nodes, partitioned, " << _threadnum
+                  << " threads pinned\n";
+    }
+
+private:
+    enum placement_mode { NONE, INTERLEAVE, PARTITION };
+
+    // from linux/mempolicy.h
+    static const int MPOL_DEFAULT = 0;
+    static const int MPOL_INTERLEAVE = 3;
+
+    struct node
+    {
+        unsigned id;
+        std::vector<unsigned> cpus;
+    };
+
+    // "0-3,8,10-11" as used in sysfs
+    static std::vector<unsigned> parse_list(const std::string &list)
+    {
+        std::vector<unsigned> values;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            unsigned first, last;
+            char dash;
+            std::stringstream range(item);
+            if (!(range >> first))
+                continue;
+            if (!(range >> dash >> last))
+                last = first;
+            for (unsigned v=first;v<=last;v++)
+                values.push_back(v);
+        }
+        return values;
+    }
+
+    // online nodes with at least one CPU this process may run on
+    void detect_nodes(void)
+    {
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return;
+
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string list;
+        if (!std::getline(online, list))
+            return;
+        std::vector<unsigned> ids = parse_list(list);
+        for (size_t i=0;i<ids.size();i++)
+        {
+            std::ifstream f(("/sys/devices/system/node/node" + std::to_string(ids[i]) + "/cpulist").c_str());
+            std::string cpulist;
+            std::getline(f, cpulist);
+            std::vector<unsigned> cpus = parse_list(cpulist);
+
+            node n;
+            n.id = ids[i];
+            for (size_t c=0;c<cpus.size();c++)
+            {
+                if (cpus[c] < CPU_SETSIZE && CPU_ISSET(cpus[c], &allowed))
+                    n.cpus.push_back(cpus[c]);
+            }
+            if (!n.cpus.empty())
+                _nodes.push_back(n);
+        }
+#endif
+    }
+
+    // mask with the bits of all nodes
+    std::vector<unsigned long> node_mask(void) const
+    {
+        const size_t bits = 8 * sizeof(unsigned long);
+        unsigned max_id = 0;
+        for (size_t n=0;n<_nodes.size();n++)
+            max_id = std::max(max_id, _nodes[n].id);
+        std::vector<unsigned long> mask(max_id / bits + 1, 0);
+        for (size_t n=0;n<_nodes.size();n++)
+            mask[_nodes[n].id / bits] |= 1UL << (_nodes[n].id % bits);
+        return mask;
+    }
+
+    void set_policy(int policy)
+    {
+#ifdef __linux__
+        std::vector<unsigned long> mask = node_mask();
+        long ret = (policy == MPOL_DEFAULT)
+            ? syscall(SYS_set_mempolicy, policy, NULL, 0)
+            : syscall(SYS_set_mempolicy, policy, mask.data(), 8 * sizeof(unsigned long) * mask.size() + 1);
+        if (ret != 0)
+            std::cerr << "numa: set_mempolicy failed: " << strerror(errno) << std::endl;
+#endif
+    }
+
+    // Threads are dealt to nodes in contiguous blocks, so the static slices
+    // of consecutive threads share a node. The memory policy is per thread,
+    // so each one also drops the interleaving it may have inherited.
+    void pin_threads(void)
+    {
+#ifdef __linux__
+        #pragma omp parallel num_threads(_threadnum)
+        {
+            unsigned tid = omp_get_thread_num();
+            set_policy(MPOL_DEFAULT);
+            const node &n = _nodes[(uint64_t) tid * _nodes.size() / _threadnum];
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (size_t c=0;c<n.cpus.size();c++)
+                CPU_SET(n.cpus[c], &set);
+            if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            {
+                #pragma omp critical
+                std::cerr << "numa: pinning thread " << tid << " failed: " << strerror(errno) << std::endl;
+            }
+        }
+#endif
+    }
+
+    placement_mode _mode;
+    unsigned _threadnum;
+    std::vector<node> _nodes;
+};
+
+// Allocator whose value-initialisation leaves elements uninitialised, so that
+// resize() does not touch the pages and the threads that fill the elements
+// first decide which node holds them.
+template <typename T>
+class first_touch_allocator : public std::allocator<T>
+{
+public:
+    template <typename U>
+    struct rebind
+    {
+        typedef first_touch_allocator<U> other;
+    };
+
+    first_touch_allocator() {}
+    template <typename U>
+    first_touch_allocator(const first_touch_allocator<U> &) {}
+
+    template <typename U>
+    void construct(U * p)
+    {
+        ::new((void *) p) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U * p, Args&&... args)
+    {
+        ::new((void *) p) U(std::forward<Args>(args)...);
+    }
+};
+
+#endif
@@ -26,7 +26,12 @@
 #include <stdint.h>
 #include <iomanip>
 #include "util.hpp"
+#include "bitmap.hpp"
+#include "sliding_queue.hpp"
+#include "engine.hpp"
+#include "numa.hpp"
 #include <chrono>
+#include <cmath>
 
 #ifdef GRANULA
 #include "granula.hpp"
@@ -69,188 +74,627 @@ void arg_init(argument_parser & arg)
     arg.add_arg("jobid","UniqueJob","id of the openg job.");
     arg.add_arg("dampingfactor","0.85","damping factor of pagerank");
     arg.add_arg("iteration","10","pagerank iterations");
+    arg.add_arg("mode","pull","pagerank kernel: pull (gather over in-edges), push (atomic scatter), pb (propagation blocking) or delta (residual propagation, needs tolerance)");
+    arg.add_arg("tolerance","0","stop once the L1 change of the ranks is below this, iteration becomes the maximum; 0 runs exactly iteration iterations");
+    arg.add_arg("cachesize","0","cache bytes per propagation blocking bin, 0 to detect the last-level cache");
+    arg.add_arg("numa","interleave","memory placement on multi-socket machines: interleave (spread all pages over the nodes), partition (pin threads to nodes and place each thread's slice of the rank arrays on its node) or none");
     arg.add_arg("output", "", "Absolute path to the file where the output will be stored");
 }
 //==============================================================//
-inline unsigned vertex_distributor(uint64_t vid, unsigned threadnum)
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+// one clone per instruction set, the loader picks the best one for the CPU
+#define PR_SIMD_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define PR_SIMD_CLONES
+#endif
+
+// Per-thread slices of the vertex arrays are cut at cache lines of doubles.
+const uint64_t pagerank_align = 64 / sizeof(double);
+
+typedef vector<double, first_touch_allocator<double> > pagerank_vector;
+
+// Contiguous per-vertex arrays used by the CSR kernels, so the per-vertex
+// phases run as unit-stride loops instead of walking vertex_property.
+class pagerank_arrays
 {
-    return vid%threadnum;
+public:
+    pagerank_vector rank;
+    pagerank_vector sum;
+    pagerank_vector contrib;
+    pagerank_vector inv_degree; // 0 for dangling vertices
+};
+
+// The arrays are allocated untouched and each thread fills the slice the
+// contrib and update phases give it, so with --numa partition every slice
+// sits on the node of its thread.
+void parallel_init(graph_t& g, unsigned threadnum, pagerank_arrays& arrays)
+{
+    uint64_t vertex_num = g.vertex_num();
+    arrays.rank.resize(vertex_num);
+    arrays.sum.resize(vertex_num);
+    arrays.contrib.resize(vertex_num);
+    arrays.inv_degree.resize(vertex_num);
+
+    #pragma omp parallel num_threads(threadnum)
+    {
+        uint64_t range_begin, range_end;
+        aligned_range(vertex_num, pagerank_align, omp_get_thread_num(), threadnum, range_begin, range_end);
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+        {
+            size_t degree = g.csr_out_edges_size(vid);
+            g.csr_vertex_property(vid).degree = degree;
+            g.csr_vertex_property(vid).rank = 1.0 / g.num_vertices();
+            g.csr_vertex_property(vid).sum = 0.0;
+
+            arrays.rank[vid] = 1.0 / g.num_vertices();
+            arrays.sum[vid] = 0.0;
+            arrays.contrib[vid] = 0.0;
+            arrays.inv_degree[vid] = (degree > 0) ? 1.0 / degree : 0.0;
+        }
+    }
+}
+
+// contrib = rank / degree over [begin, end); returns the rank held by the
+// dangling vertices of the range, i.e. this thread's share of the reduction
+PR_SIMD_CLONES
+double pagerank_contrib_kernel(const double * rank, const double * inv_degree, double * contrib,
+                               uint64_t begin, uint64_t end)
+{
+    double dangling = 0.0;
+    #pragma omp simd reduction(+:dangling)
+    for (uint64_t i=begin;i<end;i++)
+    {
+        contrib[i] = rank[i] * inv_degree[i];
+        dangling += (inv_degree[i] == 0.0) ? rank[i] : 0.0;
+    }
+    return dangling;
 }
-#ifdef USE_CSR
-void parallel_init(graph_t& g, unsigned threadnum,
-                   vector<vector<uint64_t> >& global_input_tasks)
+
+// rank = base + damping_factor * sum over [begin, end), consuming the sums;
+// returns the L1 norm of the change in rank over the range
+PR_SIMD_CLONES
+double pagerank_update_kernel(double * rank, double * sum, double base, double damping_factor,
+                              uint64_t begin, uint64_t end)
 {
-    global_input_tasks.resize(threadnum);
-    for (uint64_t vid=0;vid<g.vertex_num();vid++)
+    double change = 0.0;
+    #pragma omp simd reduction(+:change)
+    for (uint64_t i=begin;i<end;i++)
     {
-        size_t degree = g.csr_out_edges_size(vid);
-        g.csr_vertex_property(vid).degree = degree;
-        g.csr_vertex_property(vid).rank = 1.0 / g.num_vertices();
-        g.csr_vertex_property(vid).sum = 0.0;
+        double new_rank = base + damping_factor * sum[i];
+        change += fabs(new_rank - rank[i]);
+        rank[i] = new_rank;
+        sum[i] = 0.0;
+    }
+    return change;
+}
+
+// Wall time and estimated memory traffic of one phase of an iteration.
+class pagerank_phase
+{
+public:
+    pagerank_phase(const char * n, double b):name(n),bytes(b),seconds(0.0){}
 
-        global_input_tasks[vertex_distributor(vid, threadnum)].push_back(vid);
+    const char * name;
+    double bytes;    // per iteration
+    double seconds;  // accumulated over all iterations
+};
 
+void report_phases(const vector<pagerank_phase> &phases, size_t iteration, double tolerance, double change)
+{
+    if (tolerance > 0)
+        cout<<"== stopped after "<<iteration<<" iterations, L1 change "<<change
+            <<" (tolerance "<<tolerance<<")\n";
+    if (iteration == 0) return;
+
+    double total = 0.0;
+    for (size_t i=0;i<phases.size();i++)
+        total += phases[i].seconds;
+    cout<<"== iteration time: "<<total/iteration<<" sec\n";
+    for (size_t i=0;i<phases.size();i++)
+    {
+        double seconds = phases[i].seconds / iteration;
+        cout<<"== phase "<<phases[i].name<<": "<<seconds<<" sec, "
+            <<(seconds > 0 ? phases[i].bytes / seconds / 1e9 : 0.0)<<" GB/s\n";
     }
 }
 
-void parallel_pagerank(graph_t &g, size_t iteration, double damping_factor, unsigned threadnum,
-                       vector<vector<uint64_t> > &global_input_tasks,
-                       gBenchPerf_multi &perf, int perf_group)
+// Combine per-thread partial sums in a fixed order, so the result does not
+// depend on thread timing.
+inline double sum_partials(const vector<double> &partials)
 {
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
-    size_t step = 0;
-    bool stop = false;
-    double dangling_sum = 0.0;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks)
+    double total = 0.0;
+    for (size_t i=0;i<partials.size();i++)
+        total += partials[i];
+    return total;
+}
+
+// Scatter step of the push kernel: adds the contribution of every vertex to
+// the sums of its out-neighbours.
+class pagerank_scatter
+{
+public:
+    pagerank_scatter(const double * contrib, double * sum) : _contrib(contrib), _sum(sum), _value(0.0) {}
+
+    bool source(uint64_t vid)
+    {
+        _value = _contrib[vid];
+        return true;
+    }
+    bool edge(uint64_t, uint64_t dst, uint64_t, uint64_t)
+    {
+        #pragma omp atomic
+        _sum[dst] += _value;
+        return false;
+    }
+
+private:
+    const double * _contrib;
+    double * _sum;
+    double _value;
+};
+
+// Gather step of the pull kernel: sums the contributions of the in-neighbours
+// and writes the new rank straight away.
+class pagerank_gather
+{
+public:
+    pagerank_gather(const double * contrib, double * rank, double base, double damping_factor)
+        : _contrib(contrib), _rank(rank), _base(base), _damping_factor(damping_factor), _sum(0.0), change(0.0) {}
+
+    bool target(uint64_t)
+    {
+        _sum = 0.0;
+        return true;
+    }
+    bool edge(uint64_t, uint64_t src, uint64_t, uint64_t)
+    {
+        _sum += _contrib[src];
+        return false;
+    }
+    void finish(uint64_t vid)
+    {
+        double new_rank = _base + _damping_factor * _sum;
+        change += fabs(new_rank - _rank[vid]);
+        _rank[vid] = new_rank;
+    }
+
+private:
+    const double * _contrib;
+    double * _rank;
+    double _base;
+    double _damping_factor;
+    double _sum;
+public:
+    // L1 change of the ranks written by this thread
+    double change;
+};
+
+void parallel_pagerank(graph_t &g, size_t iteration, double damping_factor, double tolerance, unsigned threadnum,
+                       pagerank_arrays &arrays, gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    uint64_t edge_num = g.num_edges();
+    double * rank = arrays.rank.data();
+    double * sum = arrays.sum.data();
+    double * contrib = arrays.contrib.data();
+    vector<double> dangling_partials(threadnum, 0.0);
+    vector<double> change_partials(threadnum, 0.0);
+    size_t steps = 0;
+
+    vector<pagerank_phase> phases;
+    phases.push_back(pagerank_phase("contrib", 3.0 * sizeof(double) * vertex_num));
+    phases.push_back(pagerank_phase("scatter", (sizeof(uint64_t) + 2.0 * sizeof(double)) * edge_num
+                                               + (2.0 * sizeof(uint64_t) + sizeof(double)) * vertex_num));
+    phases.push_back(pagerank_phase("update", 3.0 * sizeof(double) * vertex_num));
+
+    #pragma omp parallel num_threads(threadnum)
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        uint64_t range_begin, range_end;
+        aligned_range(vertex_num, pagerank_align, tid, threadnum, range_begin, range_end);
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        while(!stop)
+        double t0 = omp_get_wtime();
+        for (size_t step=0;step<iteration;step++)
         {
+            dangling_partials[tid] = pagerank_contrib_kernel(rank, arrays.inv_degree.data(), contrib,
+                                                             range_begin, range_end);
+            #pragma omp barrier
+            double t1 = omp_get_wtime();
 
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                uint64_t vid=input_tasks[i];
+            double base = (1.0 - damping_factor) / vertex_num +
+                          damping_factor * sum_partials(dangling_partials) / vertex_num;
+            pagerank_scatter scatter(contrib, sum);
+            no_queue none;
+            edge_map_push<OUT_EDGES>(g, vertex_num, none, dynamic_schedule<1024>(), scatter);
+            #pragma omp barrier
+            double t2 = omp_get_wtime();
 
-                if(g.csr_vertex_property(vid).degree <= 0) {
-                    #pragma omp atomic
-                    dangling_sum += g.csr_vertex_property(vid).rank;
-                }
+            change_partials[tid] = pagerank_update_kernel(rank, sum, base, damping_factor, range_begin, range_end);
+            #pragma omp barrier
+            double t3 = omp_get_wtime();
+
+            if (tid==0)
+            {
+                phases[0].seconds += t1 - t0;
+                phases[1].seconds += t2 - t1;
+                phases[2].seconds += t3 - t2;
+                steps = step + 1;
             }
+            t0 = t3;
+            if (tolerance > 0 && sum_partials(change_partials) < tolerance)
+                break;
+        }
+
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+            g.csr_vertex_property(vid).rank = rank[vid];
+        perf.stop(tid, perf_group);
+    }
+    report_phases(phases, steps, tolerance, sum_partials(change_partials));
+}
 
+// Pull variant: each vertex gathers the contributions of its in-neighbours
+// and writes its own rank once, so no atomics are needed. The per-vertex
+// contribution rank/degree is computed once per iteration.
+void parallel_pagerank_pull(graph_t &g, size_t iteration, double damping_factor, double tolerance, unsigned threadnum,
+                            pagerank_arrays &arrays, gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    uint64_t edge_num = g.num_edges();
+    double * rank = arrays.rank.data();
+    double * contrib = arrays.contrib.data();
+    vector<double> dangling_partials(threadnum, 0.0);
+    vector<double> change_partials(threadnum, 0.0);
+    size_t steps = 0;
+
+    vector<pagerank_phase> phases;
+    phases.push_back(pagerank_phase("contrib", 3.0 * sizeof(double) * vertex_num));
+    phases.push_back(pagerank_phase("gather", (sizeof(uint64_t) + sizeof(double)) * edge_num
+                                              + (2.0 * sizeof(uint64_t) + sizeof(double)) * vertex_num));
+
+    #pragma omp parallel num_threads(threadnum)
+    {
+        unsigned tid = omp_get_thread_num();
+        uint64_t range_begin, range_end;
+        aligned_range(vertex_num, pagerank_align, tid, threadnum, range_begin, range_end);
+
+        perf.open(tid, perf_group);
+        perf.start(tid, perf_group);
+        double t0 = omp_get_wtime();
+        for (size_t step=0;step<iteration;step++)
+        {
+            dangling_partials[tid] = pagerank_contrib_kernel(rank, arrays.inv_degree.data(), contrib,
+                                                             range_begin, range_end);
             #pragma omp barrier
-            for (unsigned i=0;i<input_tasks.size();i++)
+            double t1 = omp_get_wtime();
+
+            // the gathered sum goes straight into the rank update
+            double base = (1.0 - damping_factor) / vertex_num +
+                          damping_factor * sum_partials(dangling_partials) / vertex_num;
+            pagerank_gather gather(contrib, rank, base, damping_factor);
+            edge_map_pull<IN_EDGES>(g, vertex_num, dynamic_schedule<1024>(), gather);
+            change_partials[tid] = gather.change;
+            #pragma omp barrier
+            double t2 = omp_get_wtime();
+
+            if (tid==0)
             {
-                uint64_t vid=input_tasks[i];
+                phases[0].seconds += t1 - t0;
+                phases[1].seconds += t2 - t1;
+                steps = step + 1;
+            }
+            t0 = t2;
+            if (tolerance > 0 && sum_partials(change_partials) < tolerance)
+                break;
+        }
 
-                for (uint64_t i=0;i<g.csr_out_edges_size(vid);i++)
-                {
-                    uint64_t dest_vid = g.csr_out_edge(g.csr_out_edges_begin(vid), i);
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+            g.csr_vertex_property(vid).rank = rank[vid];
+        perf.stop(tid, perf_group);
+    }
+    report_phases(phases, steps, tolerance, sum_partials(change_partials));
+}
 
-                    #pragma omp atomic
-                    g.csr_vertex_property(dest_vid).sum += g.csr_vertex_property(vid).rank / g.csr_vertex_property(vid).degree;
-                }
+// Propagation blocking (Beamer et al., IPDPS'17). Destinations are split into
+// bins small enough that a bin's slice of the sum array stays in the
+// last-level cache. Every iteration first streams (destination, contribution)
+// pairs into the bins and then accumulates one bin at a time, so the random
+// accesses of the pull kernel only ever hit cache-resident data.
+//
+// The destinations of each bin are fixed by the graph, so they are laid out
+// once (as 32-bit offsets within the bin) and every iteration only rewrites
+// the contributions in the same order.
+void parallel_pagerank_pb(graph_t &g, size_t iteration, double damping_factor, double tolerance, unsigned threadnum,
+                          size_t cache_size, pagerank_arrays &arrays, gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    uint64_t edge_num = g.num_edges();
+    double * rank = arrays.rank.data();
+    double * sum = arrays.sum.data();
+    double * contrib = arrays.contrib.data();
+    vector<double> dangling_partials(threadnum, 0.0);
+    vector<double> change_partials(threadnum, 0.0);
+    size_t steps = 0;
+
+    // half of the cache for the sums of one bin, rounded down to a power of two
+    unsigned bin_shift = 0;
+    while (((uint64_t) 2 << bin_shift) * sizeof(double) <= cache_size / 2 && bin_shift < 31)
+        bin_shift++;
+    uint64_t bin_width = (uint64_t) 1 << bin_shift;
+    uint64_t bin_num = (vertex_num + bin_width - 1) / bin_width;
+    if (bin_num == 0) bin_num = 1;
+
+    // bin_offsets[b*threadnum+t] is where thread t writes its pairs for bin b
+    vector<uint64_t> bin_offsets(bin_num * threadnum + 1, 0);
+    vector<uint32_t> bin_dest(edge_num);
+    vector<double> bin_value(edge_num);
+
+    cout<<"== propagation blocking: "<<bin_num<<" bins of "<<bin_width<<" vertices ("
+        <<cache_size/1024<<" KB cache)\n";
+
+    vector<pagerank_phase> phases;
+    phases.push_back(pagerank_phase("contrib", 3.0 * sizeof(double) * vertex_num));
+    phases.push_back(pagerank_phase("binning", (sizeof(uint64_t) + sizeof(double)) * edge_num
+                                               + (2.0 * sizeof(uint64_t) + sizeof(double)) * vertex_num));
+    phases.push_back(pagerank_phase("accumulate", (sizeof(uint32_t) + sizeof(double)) * edge_num
+                                                  + 3.0 * sizeof(double) * vertex_num));
+
+    #pragma omp parallel num_threads(threadnum)
+    {
+        unsigned tid = omp_get_thread_num();
+        uint64_t range_begin, range_end;
+        aligned_range(vertex_num, pagerank_align, tid, threadnum, range_begin, range_end);
+        vector<uint64_t> cursor(bin_num, 0);
+
+        // count the pairs each thread emits per bin, then lay out the bins
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+        {
+            uint64_t edges_begin = g.csr_out_edges_begin(vid);
+            uint64_t size = g.csr_out_edges_size(vid);
+            for (uint64_t i=0;i<size;i++)
+                cursor[g.csr_out_edge(edges_begin, i) >> bin_shift]++;
+        }
+        for (uint64_t b=0;b<bin_num;b++)
+            bin_offsets[b*threadnum+tid+1] = cursor[b];
+        #pragma omp barrier
+        #pragma omp single
+        for (uint64_t i=1;i<bin_offsets.size();i++)
+            bin_offsets[i] += bin_offsets[i-1];
+
+        for (uint64_t b=0;b<bin_num;b++)
+            cursor[b] = bin_offsets[b*threadnum+tid];
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+        {
+            uint64_t edges_begin = g.csr_out_edges_begin(vid);
+            uint64_t size = g.csr_out_edges_size(vid);
+            for (uint64_t i=0;i<size;i++)
+            {
+                uint64_t dest_vid = g.csr_out_edge(edges_begin, i);
+                bin_dest[cursor[dest_vid >> bin_shift]++] = (uint32_t) (dest_vid & (bin_width - 1));
             }
+        }
+        #pragma omp barrier
 
+        perf.open(tid, perf_group);
+        perf.start(tid, perf_group);
+        double t0 = omp_get_wtime();
+        for (size_t step=0;step<iteration;step++)
+        {
+            dangling_partials[tid] = pagerank_contrib_kernel(rank, arrays.inv_degree.data(), contrib,
+                                                             range_begin, range_end);
             #pragma omp barrier
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                uint64_t vid=input_tasks[i];
+            double t1 = omp_get_wtime();
 
-                g.csr_vertex_property(vid).rank = (1.0 - damping_factor) / g.num_vertices() +
-                                       damping_factor * (g.csr_vertex_property(vid).sum + dangling_sum / g.num_vertices());
-                g.csr_vertex_property(vid).sum = 0;
-                global_output_tasks[vertex_distributor(vid,threadnum)+tid*threadnum].push_back(vid);
+            // binning: replay the fixed layout, writing only the contributions
+            for (uint64_t b=0;b<bin_num;b++)
+                cursor[b] = bin_offsets[b*threadnum+tid];
+            for (uint64_t vid=range_begin;vid<range_end;vid++)
+            {
+                uint64_t edges_begin = g.csr_out_edges_begin(vid);
+                uint64_t size = g.csr_out_edges_size(vid);
+                double value = contrib[vid];
+                for (uint64_t i=0;i<size;i++)
+                    bin_value[cursor[g.csr_out_edge(edges_begin, i) >> bin_shift]++] = value;
             }
             #pragma omp barrier
-            dangling_sum = 0;
-
-            if(tid==0) {
-                step++;
-
-                if(step >= iteration) {
-                    stop = true;
-                }
+            double t2 = omp_get_wtime();
+
+            // accumulation: one bin per thread at a time, no atomics; the
+            // update kernel leaves the bin's sums zeroed for the next round
+            double base = (1.0 - damping_factor) / vertex_num +
+                          damping_factor * sum_partials(dangling_partials) / vertex_num;
+            double change = 0.0;
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (uint64_t b=0;b<bin_num;b++)
+            {
+                uint64_t bin_begin = b << bin_shift;
+                uint64_t bin_end = bin_begin + bin_width;
+                if (bin_end > vertex_num) bin_end = vertex_num;
+                double * bin_sums = sum + bin_begin;
+
+                for (uint64_t i=bin_offsets[b*threadnum];i<bin_offsets[(b+1)*threadnum];i++)
+                    bin_sums[bin_dest[i]] += bin_value[i];
+                change += pagerank_update_kernel(rank, sum, base, damping_factor, bin_begin, bin_end);
             }
+            change_partials[tid] = change;
             #pragma omp barrier
+            double t3 = omp_get_wtime();
+
+            if (tid==0)
+            {
+                phases[0].seconds += t1 - t0;
+                phases[1].seconds += t2 - t1;
+                phases[2].seconds += t3 - t2;
+                steps = step + 1;
+            }
+            t0 = t3;
+            if (tolerance > 0 && sum_partials(change_partials) < tolerance)
+                break;
         }
+
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+            g.csr_vertex_property(vid).rank = rank[vid];
         perf.stop(tid, perf_group);
     }
+    report_phases(phases, steps, tolerance, sum_partials(change_partials));
+
+    double bytes_moved = 0.0;
+    for (size_t i=0;i<phases.size();i++)
+        bytes_moved += phases[i].bytes;
+    cout<<"== propagation blocking: "<<bytes_moved/(1024.0*1024.0)<<" MB moved per iteration\n";
 }
 
-#else
-void parallel_init(graph_t& g, unsigned threadnum,
-                   vector<vector<uint64_t> >& global_input_tasks)
+// Scatter step of the delta kernel: pushes damping_factor times the residual
+// taken from a frontier vertex to its out-neighbours, and queues those whose
+// residual now exceeds epsilon. Dangling vertices only add to dangling.
+class pagerank_delta_push
 {
-    global_input_tasks.resize(threadnum);
-    for (vertex_iterator vit=g.vertices_begin(); vit!=g.vertices_end(); vit++)
+public:
+    pagerank_delta_push(const double * taken, const double * inv_degree, double * residual, bitmap &queued,
+                        double damping_factor, double epsilon)
+        : _taken(taken), _inv_degree(inv_degree), _residual(residual), _queued(queued),
+          _damping_factor(damping_factor), _epsilon(epsilon), _value(0.0), dangling(0.0), pushes(0) {}
+
+    bool source(uint64_t vid)
+    {
+        if (_inv_degree[vid] == 0.0)
+        {
+            dangling += _damping_factor * _taken[vid];
+            return false;
+        }
+        _value = _damping_factor * _taken[vid] * _inv_degree[vid];
+        pushes++;
+        return true;
+    }
+    bool edge(uint64_t, uint64_t dst, uint64_t, uint64_t)
     {
-        size_t degree = vit->edges_size();
-        vit->property().degree = degree;
-        vit->property().rank = 1.0 / g.num_vertices();
-        vit->property().sum = 0.0;
+        double new_residual;
+        #pragma omp atomic capture
+        new_residual = _residual[dst] += _value;
+        return fabs(new_residual) > _epsilon && _queued.set_bit_atomic(dst);
+    }
 
-        global_input_tasks[vertex_distributor(vit->id(), threadnum)].push_back(vit->id());
+private:
+    const double * _taken;
+    const double * _inv_degree;
+    double * _residual;
+    bitmap &_queued;
+    double _damping_factor;
+    double _epsilon;
+    double _value;
+public:
+    double dangling;
+    uint64_t pushes;
+};
 
+// Delta PageRank as residual propagation: each vertex holds the part of its
+// rank that has not been pushed to its neighbours yet. Only vertices whose
+// residual exceeds epsilon = tolerance/vertex_num are in the frontier; they
+// fold the residual into their rank and scatter damping_factor times it along
+// their out-edges. Residual reaching dangling vertices is spread over all
+// vertices through a single pending uniform term, which is only folded into
+// the per-vertex residuals once it exceeds epsilon itself.
+void parallel_pagerank_delta(graph_t &g, size_t iteration, double damping_factor, double tolerance,
+                             unsigned threadnum, pagerank_arrays &arrays, gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    double epsilon = tolerance / vertex_num;
+    double * rank = arrays.rank.data();
+    double * residual = arrays.sum.data();
+    const double * inv_degree = arrays.inv_degree.data();
+
+    sliding_queue<uint64_t> queue(vertex_num);
+    bitmap queued(vertex_num);
+    vector<double> taken(vertex_num);
+    vector<double> dangling_partials(threadnum, 0.0);
+    vector<uint64_t> push_counts(threadnum, 0);
+    double uniform = 0.0;
+    bool fold = false;
+    size_t steps = 0;
+
+    for (uint64_t vid=0;vid<vertex_num;vid++)
+    {
+        rank[vid] = 0.0;
+        residual[vid] = (1.0 - damping_factor) / vertex_num;
+        queue.push_back(vid);
+        queued.set_bit(vid);
     }
-}
+    queue.slide_window();
 
-void parallel_pagerank(graph_t &g, size_t iteration, double damping_factor, unsigned threadnum,
-                       vector<vector<uint64_t> > &global_input_tasks,
-                       gBenchPerf_multi &perf, int perf_group)
-{
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
-    size_t step = 0;
-    bool stop = false;
-    double dangling_sum = 0.0;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks)
+    #pragma omp parallel num_threads(threadnum)
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        queue_buffer<uint64_t> local_queue(queue);
+        uint64_t range_begin, range_end;
+        aligned_range(vertex_num, pagerank_align, tid, threadnum, range_begin, range_end);
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        while(!stop)
+        while (!queue.empty() && steps < iteration)
         {
-
-            for (unsigned i=0;i<input_tasks.size();i++)
+            // take the residuals of the frontier before anything is scattered
+            uint64_t queue_size = queue.size();
+            #pragma omp for
+            for (uint64_t i=0;i<queue_size;i++)
             {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
-
-                if(vit->property().degree <= 0) {
-                    #pragma omp atomic
-                    dangling_sum += vit->property().rank;
-                }
+                uint64_t vid = queue[i];
+                queued.clear_bit_atomic(vid);
+                taken[vid] = residual[vid];
+                residual[vid] = 0.0;
+                rank[vid] += taken[vid];
             }
 
+            pagerank_delta_push push(taken.data(), inv_degree, residual, queued, damping_factor, epsilon);
+            edge_map_push<OUT_EDGES>(g, queue, local_queue, dynamic_schedule<64>(), push);
+            push_counts[tid] += push.pushes;
+            dangling_partials[tid] = push.dangling;
             #pragma omp barrier
-            for (unsigned i=0;i<input_tasks.size();i++)
+            if (tid==0)
             {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
+                uniform += sum_partials(dangling_partials) / vertex_num;
+                fold = fabs(uniform) > epsilon;
+            }
+            #pragma omp barrier
 
-                for (edge_iterator eit=vit->edges_begin();eit!=vit->edges_end();eit++)
+            if (fold)
+            {
+                for (uint64_t vid=range_begin;vid<range_end;vid++)
                 {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator destvit = g.find_vertex(dest_vid);
-
-                    #pragma omp atomic
-                    destvit->property().sum += vit->property().rank / vit->property().degree;
+                    residual[vid] += uniform;
+                    if (fabs(residual[vid]) > epsilon && queued.set_bit_atomic(vid))
+                        local_queue.push_back(vid);
                 }
             }
-
+            local_queue.flush();
             #pragma omp barrier
-            for (unsigned i=0;i<input_tasks.size();i++)
+            if (tid==0)
             {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
-
-
-                vit->property().rank = (1.0 - damping_factor) / g.num_vertices() +
-                                       damping_factor * (vit->property().sum + dangling_sum / g.num_vertices());
-                vit->property().sum = 0;
-                global_output_tasks[vertex_distributor(vid,threadnum)+tid*threadnum].push_back(vid);
+                if (fold)
+                    uniform = 0.0;
+                queue.slide_window();
+                steps++;
             }
             #pragma omp barrier
-            dangling_sum = 0;
-
-            if(tid==0) {
-                step++;
+        }
 
-                if(step >= iteration) {
-                    stop = true;
-                }
-            }
-            #pragma omp barrier
+        // whatever was not propagated is still part of the rank
+        for (uint64_t vid=range_begin;vid<range_end;vid++)
+        {
+            rank[vid] += residual[vid] + uniform;
+            residual[vid] = 0.0;
+            g.csr_vertex_property(vid).rank = rank[vid];
         }
         perf.stop(tid, perf_group);
     }
+
+    uint64_t pushes = 0;
+    for (unsigned i=0;i<threadnum;i++)
+        pushes += push_counts[i];
+    cout<<"== delta pagerank: "<<steps<<" rounds, "<<pushes<<" vertex pushes, "
+        <<queue.size()<<" vertices above epsilon "<<epsilon<<"\n";
 }
-#endif
+
 //==============================================================//
 void output(graph_t& g)
 {
@@ -317,6 +761,29 @@ int main(int argc, char * argv[])
     arg.get_value("dampingfactor", damping_factor);
     arg.get_value("iteration", iteration);
     arg.get_value("threadnum",threadnum);
+    string numa_mode;
+    arg.get_value("numa",numa_mode);
+
+    string mode;
+    arg.get_value("mode", mode);
+    double tolerance;
+    arg.get_value("tolerance", tolerance);
+    size_t cache_size;
+    arg.get_value("cachesize", cache_size);
+    if (cache_size == 0)
+        cache_size = last_level_cache_size();
+    if (mode != "pull" && mode != "push" && mode != "pb" && mode != "delta") {
+        cerr << "unknown pagerank mode: " << mode << endl;
+        return 1;
+    }
+    if (numa_mode != "interleave" && numa_mode != "partition" && numa_mode != "none") {
+        cerr << "unknown numa mode: " << numa_mode << endl;
+        return 1;
+    }
+    if (mode == "delta" && tolerance <= 0) {
+        cerr << "pagerank mode delta requires a positive tolerance" << endl;
+        return 1;
+    }
 
     graph_t graph;
     cout<<"loading data... \n";
@@ -324,18 +791,12 @@ int main(int argc, char * argv[])
 #ifdef GRANULA
     cout<<loadGraph.getOperationInfo("StartTime", loadGraph.getEpoch())<<endl;
 #endif
+    numa_placement placement(numa_mode, threadnum);
+    placement.before_load();
     t1 = timer::get_usec();
-    string vfile = path + "/vertex.csv";
-    string efile = path + "/edge.csv";
-#ifdef USE_CSR
     if (!graph.load_CSR_Graph(path))
         return -1;
-#else
-    if (!graph.load_csv_vertices(vfile, false, " ", 0))
-        return -1;
-    if (!graph.load_csv_edges(efile, false, " ", 0, 1))
-        return -1;
-#endif
+    placement.after_load();
 
     size_t vertex_num = graph.num_vertices();
     size_t edge_num = graph.num_edges();
@@ -348,7 +809,7 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("EndTime", loadGraph.getEpoch())<<endl;
 #endif
 
-    cout<<"\nComputing pagerank..."<<endl;
+    cout<<"\nComputing pagerank ("<<mode<<")..."<<endl;
     gBenchPerf_multi perf_multi(threadnum, perf);
     unsigned run_num = ceil(perf.get_event_cnt() /(double) DEFAULT_PERF_GRP_SZ);
     if (run_num==0) run_num = 1;
@@ -362,13 +823,18 @@ int main(int argc, char * argv[])
 
     for (unsigned i=0;i<run_num;i++)
     {
-        queue<vertex_iterator> process_q;
-        vector<vector<uint64_t> > global_input_tasks(threadnum);
-
-        parallel_init(graph,threadnum,global_input_tasks);
+        pagerank_arrays arrays;
+        parallel_init(graph,threadnum,arrays);
 
         t1 = timer::get_usec();
-        parallel_pagerank(graph, iteration, damping_factor, threadnum, global_input_tasks, perf_multi, i);
+        if (mode == "pull")
+            parallel_pagerank_pull(graph, iteration, damping_factor, tolerance, threadnum, arrays, perf_multi, i);
+        else if (mode == "pb")
+            parallel_pagerank_pb(graph, iteration, damping_factor, tolerance, threadnum, cache_size, arrays, perf_multi, i);
+        else if (mode == "delta")
+            parallel_pagerank_delta(graph, iteration, damping_factor, tolerance, threadnum, arrays, perf_multi, i);
+        else
+            parallel_pagerank(graph, iteration, damping_factor, tolerance, threadnum, arrays, perf_multi, i);
         t2 = timer::get_usec();
         elapse_time += t2-t1;
         if ((i+1)<run_num) reset_graph(graph);
@@ -393,11 +859,7 @@ int main(int argc, char * argv[])
     arg.get_value("output", output_file);
 
     if (!output_file.empty()) {
-#ifdef USE_CSR
         write_csr_graph_vertices(graph, output_file);
-#else
-        write_graph_vertices(graph, output_file);
-#endif
     }
 
 #ifdef GRANULA
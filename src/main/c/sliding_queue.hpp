@@ -0,0 +1,150 @@
+/*
+ * Copyright 2015 Delft University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SLIDING_QUEUE_H
+#define SLIDING_QUEUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+template <typename T> class queue_buffer;
+
+// Shared frontier queue in the style of GAP's SlidingQueue. Threads read the
+// current window while appending the next frontier through per-thread
+// queue_buffers; slide_window() then makes the appended items the new window.
+//
+// Unlike GAP's version, consecutive windows alternate between the two halves
+// of one preallocated array, so kernels that queue a vertex in more than one
+// round (SSSP, WCC) never run off the end. The only requirement is that a
+// single round appends at most `capacity` items.
+template <typename T>
+class sliding_queue
+{
+    friend class queue_buffer<T>;
+public:
+    explicit sliding_queue(size_t capacity)
+        : _capacity(capacity), _shared(new T[2 * capacity])
+    {
+        reset();
+    }
+    ~sliding_queue()
+    {
+        delete[] _shared;
+    }
+
+    // append from a single thread, e.g. to seed the first window
+    void push_back(T to_add)
+    {
+        _shared[_shared_in++] = to_add;
+    }
+
+    bool empty(void) const
+    {
+        return _shared_out_start == _shared_out_end;
+    }
+
+    void reset(void)
+    {
+        _shared_out_start = 0;
+        _shared_out_end = 0;
+        _shared_in = 0;
+        _in_base = 0;
+    }
+
+    // publish everything appended since the last call as the new window;
+    // must be called by one thread after all queue_buffers were flushed
+    void slide_window(void)
+    {
+        _shared_out_start = _in_base;
+        _shared_out_end = _shared_in;
+        _in_base = (_in_base == 0) ? _capacity : 0;
+        _shared_in = _in_base;
+    }
+
+    size_t size(void) const
+    {
+        return _shared_out_end - _shared_out_start;
+    }
+
+    T operator[](size_t i) const
+    {
+        return _shared[_shared_out_start + i];
+    }
+
+    T * begin(void) const
+    {
+        return _shared + _shared_out_start;
+    }
+
+    T * end(void) const
+    {
+        return _shared + _shared_out_end;
+    }
+
+private:
+    sliding_queue(const sliding_queue &);
+    sliding_queue & operator=(const sliding_queue &);
+
+    size_t _capacity;
+    T * _shared;
+    size_t _shared_in;
+    size_t _shared_out_start;
+    size_t _shared_out_end;
+    size_t _in_base;
+};
+
+// Per-thread staging buffer for a sliding_queue. Items are copied into the
+// shared array in blocks, reserving space with a single fetch-and-add.
+template <typename T>
+class queue_buffer
+{
+public:
+    explicit queue_buffer(sliding_queue<T> & master, size_t given_size = 16384)
+        : _in(0), _local_size(given_size), _local_queue(new T[given_size]), _master(master)
+    {
+    }
+    ~queue_buffer()
+    {
+        delete[] _local_queue;
+    }
+
+    void push_back(T to_add)
+    {
+        if (_in == _local_size)
+            flush();
+        _local_queue[_in++] = to_add;
+    }
+
+    void flush(void)
+    {
+        if (_in == 0)
+            return;
+        size_t copy_start = __sync_fetch_and_add(&_master._shared_in, _in);
+        std::copy(_local_queue, _local_queue + _in, _master._shared + copy_start);
+        _in = 0;
+    }
+
+private:
+    queue_buffer(const queue_buffer &);
+    queue_buffer & operator=(const queue_buffer &);
+
+    size_t _in;
+    size_t _local_size;
+    T * _local_queue;
+    sliding_queue<T> & _master;
+};
+
+#endif
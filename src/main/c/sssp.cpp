@@ -30,6 +30,13 @@
 #include <iomanip>
 #include <chrono>
 #include "util.hpp"
+#include "sliding_queue.hpp"
+#include "bitmap.hpp"
+#include "worklist.hpp"
+#include "engine.hpp"
+#include "numa.hpp"
+#include <algorithm>
+#include <cstring>
 
 #ifdef HMC
 #include "HMC.h"
@@ -44,10 +51,24 @@
 #endif
 
 using namespace std;
+// delta = average weight * delta_degree_scale / average degree
+const double delta_degree_scale = 4.0;
+// a user delta must be at least this fraction of the smallest positive
+// weight; bins are indexed by distance / delta, so a tinier one would ask
+// for more bins than fit in memory
+const double delta_min_fraction = 1.0 / (1 << 20);
 size_t beginiter = 0;
 size_t enditer = 0;
 
+// Building with SSSP_FLOAT (cmake -DSSSP_FLOAT=1) keeps distances and the
+// edge weights read by the kernels in single precision.
+#ifdef SSSP_FLOAT
+typedef float distance_t;
+typedef uint32_t distance_bits_t;
+#else
 typedef double distance_t;
+typedef uint64_t distance_bits_t;
+#endif
 #define MY_INFINITY (numeric_limits<distance_t>::max())
 
 class vertex_property
@@ -90,6 +111,9 @@ void arg_init(argument_parser & arg)
 {
     arg.add_arg("jobid","UniqueJob","id of the openg job.");
     arg.add_arg("root","0","root/starting vertex");
+    arg.add_arg("mode","delta","sssp kernel: delta (delta-stepping), frontier (Bellman-Ford over the improved vertices), or async (Bellman-Ford without rounds)");
+    arg.add_arg("delta","0","delta-stepping bucket width; 0 picks it from the average edge weight and degree");
+    arg.add_arg("numa","interleave","memory placement on multi-socket machines: interleave (spread all pages over the nodes) or none");
     arg.add_arg("output", "", "Absolute path to the file where the output will be stored");
 }
 //==============================================================//
@@ -147,195 +171,471 @@ void sssp(graph_t& g, size_t src, gBenchPerf_event & perf, int perf_group)
 }
 */
 
-inline unsigned vertex_distributor(uint64_t vid, unsigned threadnum)
+// Lower *addr to value if value is smaller; returns true if this call did.
+// Relaxations use this instead of a per-vertex lock: a compare-and-swap on
+// the bit pattern of the distance, retried while value still improves it.
+inline bool atomic_min_distance(distance_t * addr, distance_t value)
 {
-    return vid%threadnum;
+    distance_bits_t * bits = reinterpret_cast<distance_bits_t *>(addr);
+    distance_t old_value = *addr;
+    while (value < old_value)
+    {
+        distance_bits_t old_bits, new_bits;
+        memcpy(&old_bits, &old_value, sizeof(old_bits));
+        memcpy(&new_bits, &value, sizeof(new_bits));
+        distance_bits_t seen = __sync_val_compare_and_swap(bits, old_bits, new_bits);
+        if (seen == old_bits)
+            return true;
+        memcpy(&old_value, &seen, sizeof(seen));
+    }
+    return false;
 }
-#ifdef USE_CSR
-void parallel_sssp(graph_t& g, size_t root, unsigned threadnum, gBenchPerf_multi & perf, int perf_group)
+
+// Edge weights as the kernels read them, indexed like csr_out_edge_weight.
+// The CSR graph stores double weights; with SSSP_FLOAT they are copied once
+// into a float array so that the relaxation loops touch 4 bytes per edge.
+class edge_weights
 {
-    g.csr_vertex_property(root).distance = 0;
-    g.csr_vertex_property(root).update = 0;
+public:
+    edge_weights(graph_t& g, unsigned threadnum) : _g(g), _inexact(0)
+    {
+#ifdef SSSP_FLOAT
+        uint64_t vertex_num = g.num_vertices();
+        _weights.resize(g.num_edges());
+        uint64_t inexact = 0;
+        #pragma omp parallel for num_threads(threadnum) schedule(dynamic, 1024) reduction(+:inexact)
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            uint64_t edges_begin = g.csr_out_edges_begin(vid);
+            for (uint64_t i=0;i<g.csr_out_edges_size(vid);i++)
+            {
+                double weight = g.csr_out_edge_weight(edges_begin, i);
+                _weights[edges_begin + i] = (float) weight;
+                if ((double) _weights[edges_begin + i] != weight)
+                    inexact++;
+            }
+        }
+        _inexact = inexact;
+#endif
+    }
+
+    distance_t operator()(uint64_t edges_begin, uint64_t i) const
+    {
+#ifdef SSSP_FLOAT
+        return _weights[edges_begin + i];
+#else
+        return _g.csr_out_edge_weight(edges_begin, i);
+#endif
+    }
+
+    // number of weights changed by the conversion to distance_t
+    uint64_t inexact(void) const
+    {
+        return _inexact;
+    }
+
+private:
+    graph_t& _g;
+    uint64_t _inexact;
+#ifdef SSSP_FLOAT
+    vector<float> _weights;
+#endif
+};
+
+// Delta heuristic: buckets about as wide as the weight of an average edge
+// scaled down by the average degree, so that a bucket holds roughly one
+// expansion step worth of distance and most edges of sparse graphs are light.
+double default_delta(graph_t& g)
+{
+    uint64_t vertex_num = g.num_vertices();
+    uint64_t edge_num = g.num_edges();
+    if (edge_num == 0)
+        return 1.0;
+
+    double weight_sum = 0.0;
+    for (uint64_t vid=0;vid<vertex_num;vid++)
+    {
+        uint64_t edges_begin = g.csr_out_edges_begin(vid);
+        for (uint64_t i=0;i<g.csr_out_edges_size(vid);i++)
+            weight_sum += g.csr_out_edge_weight(edges_begin, i);
+    }
+    double average_weight = weight_sum / edge_num;
+    double average_degree = (double) edge_num / vertex_num;
+    double delta = average_weight * delta_degree_scale / average_degree;
+    return (delta > 0) ? delta : 1.0;
+}
+
+// smallest positive edge weight, 0 if there is none
+double min_positive_weight(graph_t& g)
+{
+    uint64_t vertex_num = g.num_vertices();
+    double min_weight = 0.0;
+    for (uint64_t vid=0;vid<vertex_num;vid++)
+    {
+        uint64_t edges_begin = g.csr_out_edges_begin(vid);
+        for (uint64_t i=0;i<g.csr_out_edges_size(vid);i++)
+        {
+            double weight = g.csr_out_edge_weight(edges_begin, i);
+            if (weight > 0 && (min_weight == 0 || weight < min_weight))
+                min_weight = weight;
+        }
+    }
+    return min_weight;
+}
 
-    bool * locks = new bool[g.num_vertices()];
-    memset(locks, 0, sizeof(bool)*g.num_vertices());
+// Relaxes the out-edges of a source into the TARGET distance of their heads;
+// a head is queued only if its distance dropped and queued_bits did not have
+// it yet. With CLEAR_QUEUED the source leaves queued_bits before its
+// distance is read, so a later improvement queues it again.
+template <distance_t vertex_property::*TARGET, bool CLEAR_QUEUED>
+class sssp_relax
+{
+public:
+    sssp_relax(graph_t &g, const edge_weights &weights, bitmap &queued_bits)
+        : _g(g), _weights(weights), _queued_bits(queued_bits), _dist(0), relaxations(0) {}
+
+    bool source(uint64_t vid)
+    {
+        if (CLEAR_QUEUED)
+            _queued_bits.clear_bit_atomic(vid);
+        _dist = _g.csr_vertex_property(vid).distance;
+        relaxations += _g.csr_out_edges_size(vid);
+        return true;
+    }
+    bool edge(uint64_t, uint64_t dst, uint64_t edges_begin, uint64_t i)
+    {
+        distance_t new_dist = _dist + _weights(edges_begin, i);
+        return atomic_min_distance(&(_g.csr_vertex_property(dst).*TARGET), new_dist)
+               && _queued_bits.set_bit_atomic(dst);
+    }
+
+private:
+    graph_t &_g;
+    const edge_weights &_weights;
+    bitmap &_queued_bits;
+    distance_t _dist;
+public:
+    uint64_t relaxations;
+};
 
-    vector<vector<uint64_t> > global_input_tasks(threadnum);
-    global_input_tasks[vertex_distributor(root,threadnum)].push_back(root);
+// Per-thread bins of delta-stepping, indexed by distance / delta.
+class sssp_bins
+{
+public:
+    void push(size_t bin, uint64_t vid)
+    {
+        if (bin >= _bins.size())
+            _bins.resize(bin + 1);
+        _bins[bin].push_back(vid);
+    }
 
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
+    // smallest non-empty bin after bin, or no_bin
+    size_t next(size_t bin, size_t no_bin) const
+    {
+        for (size_t b=bin+1;b<_bins.size();b++)
+        {
+            if (!_bins[b].empty())
+                return b;
+        }
+        return no_bin;
+    }
 
+    size_t size(void) const
+    {
+        return _bins.size();
+    }
 
-    bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks)
+    vector<uint64_t> & operator[](size_t bin)
+    {
+        return _bins[bin];
+    }
+
+private:
+    vector<vector<uint64_t> > _bins;
+};
+
+// Relaxes the light (HEAVY false) or heavy (HEAVY true) out-edges of the
+// current bucket's vertices. Heads that stay in the current bucket are
+// queued for another light round, the others go to this thread's bins.
+template <bool HEAVY>
+class sssp_bucket_relax
+{
+public:
+    sssp_bucket_relax(graph_t &g, const edge_weights &weights, distance_t delta, size_t curr_bin,
+                      bitmap &queued_bits, bitmap &removed_bits, vector<uint64_t> &removed, sssp_bins &bins)
+        : _g(g), _weights(weights), _delta(delta), _curr_bin(curr_bin), _bin_begin(delta * curr_bin),
+          _queued_bits(queued_bits), _removed_bits(removed_bits), _removed(removed), _bins(bins),
+          _dist(0), relaxations(0) {}
+
+    bool source(uint64_t vid)
+    {
+        if (HEAVY)
+        {
+            // distances of the removed vertices are final now
+            _removed_bits.clear_bit_atomic(vid);
+            _dist = _g.csr_vertex_property(vid).distance;
+            return true;
+        }
+        // cleared before reading the distance, so that a later
+        // improvement queues the vertex again
+        _queued_bits.clear_bit_atomic(vid);
+        _dist = _g.csr_vertex_property(vid).distance;
+        // settled in an earlier bucket
+        if (_dist < _bin_begin)
+            return false;
+        if (_removed_bits.set_bit_atomic(vid))
+            _removed.push_back(vid);
+        return true;
+    }
+    bool edge(uint64_t, uint64_t dst, uint64_t edges_begin, uint64_t i)
+    {
+        distance_t weight = _weights(edges_begin, i);
+        if ((weight > _delta) != HEAVY)
+            return false;
+        distance_t new_dist = _dist + weight;
+        relaxations++;
+        if (!atomic_min_distance(&(_g.csr_vertex_property(dst).distance), new_dist))
+            return false;
+
+        size_t dest_bin = (size_t) (new_dist / _delta);
+        if (!HEAVY && dest_bin <= _curr_bin)
+            return _queued_bits.set_bit_atomic(dst);
+        _bins.push(dest_bin, dst);
+        return false;
+    }
+
+private:
+    graph_t &_g;
+    const edge_weights &_weights;
+    distance_t _delta;
+    size_t _curr_bin;
+    distance_t _bin_begin;
+    bitmap &_queued_bits;
+    bitmap &_removed_bits;
+    vector<uint64_t> &_removed;
+    sssp_bins &_bins;
+    distance_t _dist;
+public:
+    uint64_t relaxations;
+};
+
+// Delta-stepping after Meyer and Sanders. Vertices are kept in buckets of
+// width delta, each thread holding its own bins. The current bucket is
+// settled by repeatedly relaxing the light edges (weight <= delta) of its
+// frontier, which may refill the same bucket; then the heavy edges of every
+// vertex removed from it are relaxed once, as they can only reach later
+// buckets. The next bucket is the smallest non-empty bin over all threads.
+void parallel_sssp_delta(graph_t& g, const edge_weights& weights, size_t root, distance_t delta,
+                         unsigned threadnum, gBenchPerf_multi & perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    g.csr_vertex_property(root).distance = 0;
+    g.csr_vertex_property(root).update = 0;
+
+    // the current bits keep a vertex in the frontier at most once
+    vertex_frontier frontier(vertex_num);
+    frontier.queue.push_back(root);
+    frontier.queue.slide_window();
+    bitmap &queued_bits = frontier.current_bits();
+
+    bitmap removed_bits(vertex_num);
+    vector<size_t> next_bins(threadnum);
+    vector<uint64_t> relax_counts(threadnum, 0);
+    size_t curr_bin = 0;
+    size_t bucket_count = 0;
+    const size_t no_bin = numeric_limits<size_t>::max();
+
+    #pragma omp parallel num_threads(threadnum)
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        queue_buffer<uint64_t> local_queue(frontier.queue);
+        sssp_bins local_bins;
+        vector<uint64_t> removed;
+        uint64_t relaxations = 0;
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        while(!stop)
+        while (curr_bin != no_bin)
         {
-            #pragma omp barrier
-            // process local queue
-            stop = true;
-            for (unsigned i=0;i<input_tasks.size();i++)
+            // light phase, until the bucket stays empty
+            while (!frontier.queue.empty())
             {
-                uint64_t vid=input_tasks[i];
+                sssp_bucket_relax<false> light(g, weights, delta, curr_bin, queued_bits,
+                                               removed_bits, removed, local_bins);
+                edge_map_push<OUT_EDGES>(g, frontier.queue, local_queue, dynamic_schedule<64>(), light);
+                relaxations += light.relaxations;
+                #pragma omp barrier
+                if (tid==0)
+                    frontier.queue.slide_window();
+                #pragma omp barrier
+            }
 
-                distance_t curr_dist = g.csr_vertex_property(vid).distance;
+            // heavy phase over the vertices this thread removed
+            sssp_bucket_relax<true> heavy(g, weights, delta, curr_bin, queued_bits,
+                                          removed_bits, removed, local_bins);
+            no_queue none;
+            for (size_t i=0;i<removed.size();i++)
+            {
+                heavy.source(removed[i]);
+                push_edges<OUT_EDGES>(g, removed[i], heavy, none);
+            }
+            relaxations += heavy.relaxations;
+            removed.clear();
 
-                uint64_t edges_begin = g.csr_out_edges_begin(vid);
-                for (uint64_t i=0;i<g.csr_out_edges_size(vid);i++)
-                {
-                    uint64_t dest_vid = g.csr_out_edge(edges_begin,i);
-                    distance_t new_dist = curr_dist + g.csr_out_edge_weight(edges_begin, i);
-                    bool active=false;
-
-                    // spinning lock for critical section
-                    //  can be replaced as an atomicMin operation
-                    while(__sync_lock_test_and_set(&(locks[dest_vid]),1));
-                    if (g.csr_vertex_property(dest_vid).update>new_dist)
-                    {
-                        active = true;
-                        g.csr_vertex_property(dest_vid).update = new_dist;
-                    }
-                    __sync_lock_release(&(locks[dest_vid]));
-
-                    if (active)
-                    {
-                        global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                    }
-                }
+            // smallest non-empty bin over all threads becomes the next bucket
+            next_bins[tid] = local_bins.next(curr_bin, no_bin);
+            #pragma omp barrier
+            if (tid==0)
+            {
+                curr_bin = *min_element(next_bins.begin(), next_bins.end());
+                bucket_count++;
             }
             #pragma omp barrier
-            input_tasks.clear();
-            for (unsigned i=0;i<threadnum;i++)
+
+            if (curr_bin != no_bin && curr_bin < local_bins.size())
             {
-                if (global_output_tasks[i*threadnum+tid].size()!=0)
+                // skip entries that moved to an earlier bucket since, and
+                // vertices binned more than once
+                distance_t bin_begin = delta * curr_bin;
+                vector<uint64_t> &bin = local_bins[curr_bin];
+                for (size_t i=0;i<bin.size();i++)
                 {
-                    stop = false;
-                    input_tasks.insert(input_tasks.end(),
-                            global_output_tasks[i*threadnum+tid].begin(),
-                            global_output_tasks[i*threadnum+tid].end());
-                    global_output_tasks[i*threadnum+tid].clear();
+                    uint64_t vid = bin[i];
+                    if (g.csr_vertex_property(vid).distance >= bin_begin
+                        && queued_bits.set_bit_atomic(vid))
+                        local_queue.push_back(vid);
                 }
+                bin.clear();
             }
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                uint64_t vid = input_tasks[i];
-                g.csr_vertex_property(vid).distance = g.csr_vertex_property(vid).update;
-            }
+            local_queue.flush();
+            #pragma omp barrier
+            if (tid==0)
+                frontier.queue.slide_window();
             #pragma omp barrier
         }
+        relax_counts[tid] = relaxations;
         perf.stop(tid, perf_group);
     }
 
+    uint64_t relaxations = 0;
+    for (unsigned i=0;i<threadnum;i++)
+        relaxations += relax_counts[i];
+    cout<<"== delta-stepping: delta "<<delta<<", "<<bucket_count<<" buckets, "
+        <<relaxations<<" edge relaxations\n";
 
-    delete[] locks;
+    #pragma omp parallel for num_threads(threadnum)
+    for (uint64_t vid=0;vid<vertex_num;vid++)
+        g.csr_vertex_property(vid).update = g.csr_vertex_property(vid).distance;
 }
 
-#else
-void parallel_sssp(graph_t& g, size_t root, unsigned threadnum, gBenchPerf_multi & perf, int perf_group)
+// Asynchronous Bellman-Ford: a vertex whose distance was lowered goes into
+// the worklist right away and is relaxed without waiting for a round to end.
+// Reaches the same distances as the other kernels.
+void parallel_sssp_async(graph_t& g, const edge_weights& weights, size_t root, unsigned threadnum,
+                         gBenchPerf_multi & perf, int perf_group)
 {
-    vertex_iterator rootvit=g.find_vertex(root);
-    rootvit->property().distance = 0;
-    rootvit->property().update = 0;
+    uint64_t vertex_num = g.num_vertices();
+    g.csr_vertex_property(root).distance = 0;
 
-    //vector<uint16_t> update(g.num_vertices(), MY_INFINITY);
-    //update[root] = 0;
+    async_worklist<uint64_t> worklist(threadnum);
+    // set while a vertex waits in the worklist, cleared before its distance is read
+    bitmap queued_bits(vertex_num);
+    vector<uint64_t> relax_counts(threadnum, 0);
 
-    bool * locks = new bool[g.num_vertices()];
-    memset(locks, 0, sizeof(bool)*g.num_vertices());
+    #pragma omp parallel num_threads(threadnum)
+    {
+        unsigned tid = omp_get_thread_num();
+        vector<uint64_t> chunk;
+        worklist_sink<uint64_t> sink(worklist, tid);
+        sssp_relax<&vertex_property::distance, true> relax(g, weights, queued_bits);
 
-    vector<vector<uint64_t> > global_input_tasks(threadnum);
-    global_input_tasks[vertex_distributor(root,threadnum)].push_back(root);
+        perf.open(tid, perf_group);
+        perf.start(tid, perf_group);
+        if (tid==0)
+        {
+            queued_bits.set_bit_atomic(root);
+            worklist.push(tid, root);
+            worklist.flush(tid);
+        }
+        #pragma omp barrier
 
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
+        while (worklist.pop(tid, chunk))
+        {
+            for (size_t k=0;k<chunk.size();k++)
+            {
+                relax.source(chunk[k]);
+                push_edges<OUT_EDGES>(g, chunk[k], relax, sink);
+            }
+            worklist.done(tid, chunk.size());
+        }
+        relax_counts[tid] = relax.relaxations;
+        perf.stop(tid, perf_group);
+    }
 
+    uint64_t relaxations = 0;
+    for (unsigned i=0;i<threadnum;i++)
+        relaxations += relax_counts[i];
+    cout<<"== async: "<<relaxations<<" edge relaxations, "<<worklist.steals()<<" chunks stolen\n";
+
+    #pragma omp parallel for num_threads(threadnum)
+    for (uint64_t vid=0;vid<vertex_num;vid++)
+        g.csr_vertex_property(vid).update = g.csr_vertex_property(vid).distance;
+}
+
+void parallel_sssp(graph_t& g, const edge_weights& weights, size_t root, unsigned threadnum,
+                   gBenchPerf_multi & perf, int perf_group)
+{
+    uint64_t vertex_num = g.num_vertices();
+    g.csr_vertex_property(root).distance = 0;
+    g.csr_vertex_property(root).update = 0;
 
-    bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks)
+    // the current bits keep a vertex improved by several edges in one round
+    // from being queued more than once
+    vertex_frontier frontier(vertex_num);
+    sliding_queue<uint64_t> &queue = frontier.queue;
+    queue.push_back(root);
+    queue.slide_window();
+    bitmap &queued_bits = frontier.current_bits();
+    vector<uint64_t> relax_counts(threadnum, 0);
+    size_t round_count = 0;
+
+    #pragma omp parallel num_threads(threadnum)
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        queue_buffer<uint64_t> local_queue(queue);
+        sssp_relax<&vertex_property::update, false> relax(g, weights, queued_bits);
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-#ifdef SIM
-        unsigned iter = 0;
-#endif
-        while(!stop)
+        while(!queue.empty())
         {
+            edge_map_push<OUT_EDGES>(g, queue, local_queue, dynamic_schedule<64>(), relax);
             #pragma omp barrier
-            // process local queue
-            stop = true;
-#ifdef SIM
-            SIM_BEGIN(iter==beginiter);
-            iter++;
-#endif
-            for (unsigned i=0;i<input_tasks.size();i++)
+            if (tid==0)
             {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
-
-                distance_t curr_dist = vit->property().distance;
-                for (edge_iterator eit=vit->edges_begin();eit!=vit->edges_end();eit++)
-                {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator dvit = g.find_vertex(dest_vid);
-                    distance_t new_dist = curr_dist + eit->property().weight;
-                    bool active=false;
-
-                    // spinning lock for critical section
-                    //  can be replaced as an atomicMin operation
-                    while(__sync_lock_test_and_set(&(locks[dest_vid]),1));
-                    if (dvit->property().update>new_dist)
-                    {
-                        active = true;
-                        dvit->property().update = new_dist;
-                    }
-                    __sync_lock_release(&(locks[dest_vid]));
-
-                    if (active)
-                    {
-                        global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                    }
-                }
+                queue.slide_window();
+                round_count++;
             }
-#ifdef SIM
-            SIM_END(iter==enditer);
-#endif
             #pragma omp barrier
-            input_tasks.clear();
-            for (unsigned i=0;i<threadnum;i++)
-            {
-                if (global_output_tasks[i*threadnum+tid].size()!=0)
-                {
-                    stop = false;
-                    input_tasks.insert(input_tasks.end(),
-                            global_output_tasks[i*threadnum+tid].begin(),
-                            global_output_tasks[i*threadnum+tid].end());
-                    global_output_tasks[i*threadnum+tid].clear();
-                }
-            }
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                vertex_iterator vit = g.find_vertex(input_tasks[i]);
-                vit->property().distance = vit->property().update;
-            }
+
+            uint64_t queue_size = queue.size();
+            vertex_map(queue_size, range_schedule(), [&](uint64_t i) {
+                uint64_t vid = queue[i];
+                queued_bits.clear_bit_atomic(vid);
+                g.csr_vertex_property(vid).distance = g.csr_vertex_property(vid).update;
+            });
             #pragma omp barrier
         }
-#ifdef SIM
-        SIM_END(enditer==0);
-#endif
+        relax_counts[tid] = relax.relaxations;
         perf.stop(tid, perf_group);
     }
 
-
-    delete[] locks;
+    uint64_t relaxations = 0;
+    for (unsigned i=0;i<threadnum;i++)
+        relaxations += relax_counts[i];
+    cout<<"== frontier: "<<round_count<<" rounds, "<<relaxations<<" edge relaxations\n";
 }
-#endif
+
 //==============================================================//
 void output(graph_t& g)
 {
@@ -414,7 +714,21 @@ int main(int argc, char * argv[])
     size_t root,threadnum;
     arg.get_value("root",root);
     arg.get_value("threadnum",threadnum);
+    string numa_mode;
+    arg.get_value("numa",numa_mode);
+    if (numa_mode != "interleave" && numa_mode != "none") {
+        cerr << "unknown numa mode: " << numa_mode << endl;
+        return 1;
+    }
     arg.get_value("jobid",jobId);
+    string mode;
+    arg.get_value("mode", mode);
+    double delta;
+    arg.get_value("delta", delta);
+    if (mode != "delta" && mode != "frontier" && mode != "async") {
+        cerr << "unknown sssp mode: " << mode << endl;
+        return 1;
+    }
 
 #ifdef GRANULA
     granula::linkNode(jobId);
@@ -428,18 +742,11 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("StartTime", loadGraph.getEpoch())<<endl;
 #endif
 
+    numa_placement placement(numa_mode, threadnum);
+    placement.before_load();
     t1 = timer::get_usec();
-    string vfile = path + "/vertex.csv";
-    string efile = path + "/edge.csv";
-#ifdef USE_CSR
     if (!graph.load_CSR_Graph(path))
         return -1;
-#else
-    if (!graph.load_csv_vertices(vfile, false, " ", 0))
-        return -1;
-    if (!graph.load_csv_edges(efile, false, " ", 0, 1))
-        return -1;
-#endif
 
     size_t vertex_num = graph.num_vertices();
     size_t edge_num = graph.num_edges();
@@ -451,16 +758,30 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("EndTime", loadGraph.getEpoch())<<endl;
 #endif
 
-#ifdef USE_CSR
     uint64_t newroot;
+    bool ids_ordered = csr_ids_ordered(threadnum, graph);
 
-    if (!csr_external_to_internal_id(threadnum, graph, root, newroot)) {
+    if (!csr_external_to_internal_id(threadnum, graph, root, newroot, ids_ordered)) {
         cerr << "failed find vertex with external id: " << root << endl;
         return 1;
     }
 
     root = newroot;
-#endif
+
+    if (mode == "delta" && delta <= 0)
+        delta = default_delta(graph);
+    else if (mode == "delta") {
+        double min_delta = min_positive_weight(graph) * delta_min_fraction;
+        if (delta < min_delta) {
+            cerr << "delta " << delta << " is too small for the edge weights, use at least " << min_delta << endl;
+            return 1;
+        }
+    }
+
+    edge_weights weights(graph, threadnum);
+    if (weights.inexact() > 0)
+        cerr << "warning: " << weights.inexact() << " of " << graph.num_edges()
+             << " edge weights are not exactly representable as float" << endl;
 
     cout<<"Shortest Path: source-"<<root;
     cout<<"...\n";
@@ -480,7 +801,12 @@ int main(int argc, char * argv[])
     {
         t1 = timer::get_usec();
 
-        parallel_sssp(graph, root, threadnum, perf_multi, i);
+        if (mode == "delta")
+            parallel_sssp_delta(graph, weights, root, delta, threadnum, perf_multi, i);
+        else if (mode == "async")
+            parallel_sssp_async(graph, weights, root, threadnum, perf_multi, i);
+        else
+            parallel_sssp(graph, weights, root, threadnum, perf_multi, i);
 
         t2 = timer::get_usec();
         elapse_time += t2-t1;
@@ -506,11 +832,7 @@ int main(int argc, char * argv[])
     arg.get_value("output", output_file);
 
     if (!output_file.empty()) {
-#ifdef USE_CSR
         write_csr_graph_vertices(graph, output_file);
-#else
-        write_graph_vertices(graph, output_file);
-#endif
     }
 
 #ifdef GRANULA
@@ -15,9 +15,8 @@ ifeq (${TEST}, 1)
   CXX_FLAGS += -DGRANULA
 endif
 
-ifeq (${CSR}, 1)
-  CXX_FLAGS += -DUSE_CSR
-endif
+## the benchmarks only support the CSR graph format
+CXX_FLAGS += -DUSE_CSR
 
 ifeq (${PFM},0)
   CXX_FLAGS += -DNO_PFM
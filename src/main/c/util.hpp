@@ -22,9 +22,17 @@
 #include <stdint.h>
 #include <string>
 #include <limits>
+#include <vector>
+#include <unordered_map>
+#include <unistd.h>
 
 #include "openG.h"
 
+// the benchmarks only support openG's CSR graph format
+#ifndef USE_CSR
+#error "build with -DUSE_CSR"
+#endif
+
 template <typename G>
 bool write_graph_vertices(G &graph, const std::string &file) {
     typedef typename G::vertex_iterator vertex_iterator;
@@ -50,7 +58,28 @@ bool write_graph_vertices(G &graph, const std::string &file) {
     return true;
 }
 
-#ifdef USE_CSR
+// Size of the last-level cache in bytes, or fallback if it cannot be detected.
+inline size_t last_level_cache_size(size_t fallback = 8 * 1024 * 1024) {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (size > 0)
+        return size;
+#endif
+    for (int index = 3; index >= 2; index--) {
+        std::ifstream f(("/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/size").c_str());
+        size_t value;
+        std::string unit;
+        if (f >> value) {
+            f >> unit;
+            if (unit == "K") value *= 1024;
+            else if (unit == "M") value *= 1024 * 1024;
+            return value;
+        }
+    }
+    return fallback;
+}
 
 template <typename G>
 bool write_csr_graph_vertices(G &graph, const std::string &file, bool value_convert=false) {
@@ -87,13 +116,53 @@ bool write_csr_graph_vertices(G &graph, const std::string &file, bool value_conv
     return true;
 }
 
+// True if internal ids were assigned in increasing external-id order, which
+// is the case when vertex.csv was sorted numerically before genCSR ran (see
+// load-graph.sh). Internal ids can then be compared instead of external ids,
+// and external ids can be looked up with a binary search.
 template <typename G>
-bool csr_external_to_internal_id(size_t threadnum, G &graph, uint64_t ext_id, uint64_t &int_id) {
+bool csr_ids_ordered(size_t threadnum, G &graph) {
+    size_t vertex_num = graph.vertex_num();
+    uint64_t unordered = 0;
+
+    #pragma omp parallel for num_threads(threadnum) reduction(+:unordered)
+    for (uint64_t vid = 1; vid < vertex_num; vid++) {
+        if (graph.csr_external_id(vid - 1) >= graph.csr_external_id(vid))
+            unordered++;
+    }
+
+    return unordered == 0;
+}
+
+// Internal id of ext_id by binary search; only valid if csr_ids_ordered.
+template <typename G>
+bool csr_search_internal_id(G &graph, uint64_t ext_id, uint64_t &int_id) {
+    uint64_t low = 0, high = graph.vertex_num();
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (graph.csr_external_id(mid) < ext_id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low == graph.vertex_num() || graph.csr_external_id(low) != ext_id)
+        return false;
+    int_id = low;
+    return true;
+}
+
+template <typename G>
+bool csr_external_to_internal_id(size_t threadnum, G &graph, uint64_t ext_id, uint64_t &int_id,
+                                 bool ordered=false) {
+    if (ordered)
+        return csr_search_internal_id(graph, ext_id, int_id);
+
     size_t vertex_num = graph.vertex_num();
     bool success = false;
     uint64_t result_id = true;
 
-    #pragma omp parallel num_threads(threadnum)
+    #pragma omp parallel for num_threads(threadnum)
     for (uint64_t vid = 0; vid < vertex_num; vid++) {
         if (graph.csr_external_id(vid) == ext_id) {
             #pragma omp critical
@@ -108,6 +177,45 @@ bool csr_external_to_internal_id(size_t threadnum, G &graph, uint64_t ext_id, ui
     return success;
 }
 
-#endif
+// Translate a batch of external ids, by binary search if the ids are ordered
+// and otherwise in a single pass over the vertices.
+template <typename G>
+bool csr_external_to_internal_ids(size_t threadnum, G &graph, const std::vector<uint64_t> &ext_ids,
+                                  std::vector<uint64_t> &int_ids, bool ordered=false) {
+    size_t vertex_num = graph.vertex_num();
+    std::unordered_map<uint64_t, uint64_t> found;
+
+    if (ordered) {
+        for (size_t i = 0; i < ext_ids.size(); i++) {
+            uint64_t int_id = vertex_num;
+            csr_search_internal_id(graph, ext_ids[i], int_id);
+            found[ext_ids[i]] = int_id;
+        }
+    } else {
+        for (size_t i = 0; i < ext_ids.size(); i++) {
+            found[ext_ids[i]] = vertex_num;
+        }
+
+        #pragma omp parallel for num_threads(threadnum)
+        for (uint64_t vid = 0; vid < vertex_num; vid++) {
+            std::unordered_map<uint64_t, uint64_t>::iterator it = found.find(graph.csr_external_id(vid));
+            if (it != found.end()) {
+                it->second = vid;
+            }
+        }
+    }
+
+    bool success = true;
+    int_ids.resize(ext_ids.size());
+    for (size_t i = 0; i < ext_ids.size(); i++) {
+        int_ids[i] = found[ext_ids[i]];
+        if (int_ids[i] == vertex_num) {
+            std::cerr << "failed find vertex with external id: " << ext_ids[i] << std::endl;
+            success = false;
+        }
+    }
+
+    return success;
+}
 
 #endif
@@ -22,11 +22,18 @@
 #include "def.h"
 #include "perf.h"
 #include "util.hpp"
+#include "bitmap.hpp"
+#include "sliding_queue.hpp"
+#include "worklist.hpp"
+#include "engine.hpp"
+#include "numa.hpp"
 #include <chrono>
 #include "openG.h"
 #include <queue>
 #include "omp.h"
 #include <stdint.h>
+#include <random>
+#include <unordered_map>
 
 #ifdef SIM
 #include "SIM.h"
@@ -39,6 +46,13 @@
 using namespace std;
 
 #define MY_INFINITY 0xffffff00
+// out-neighbours each vertex links before afforest samples the giant component
+const unsigned afforest_sample_rounds = 2;
+// label propagation pulls when the frontier has more than
+// 1/wcc_pull_edge_divisor of all edge endpoints or more than
+// 1/wcc_pull_vertex_divisor of all vertices
+const uint64_t wcc_pull_edge_divisor = 4;
+const uint64_t wcc_pull_vertex_divisor = 16;
 
 class vertex_property
 {
@@ -71,192 +85,393 @@ typedef graph_t::edge_iterator      edge_iterator;
 void arg_init(argument_parser & arg)
 {
     arg.add_arg("jobid","UniqueJob","id of the openg job.");
+    arg.add_arg("mode","afforest","wcc kernel: afforest (sampled union-find), unionfind, label (label propagation), or async (label propagation without supersteps)");
+    arg.add_arg("numa","interleave","memory placement on multi-socket machines: interleave (spread all pages over the nodes) or none");
     arg.add_arg("output", "", "Absolute path to the file where the output will be stored");
 }
 //==============================================================//
 
 
-inline unsigned vertex_distributor(uint64_t vid, unsigned threadnum)
+void parallel_init(graph_t& g, unsigned threadnum)
 {
-    return vid%threadnum;
-}
-#ifdef USE_CSR
-void parallel_init(graph_t& g, unsigned threadnum,
-                   vector<vector<uint64_t> >& global_input_tasks)
-{
-    global_input_tasks.resize(threadnum);
-
+    #pragma omp parallel for num_threads(threadnum)
     for (uint64_t vid=0;vid<g.vertex_num();vid++)
     {
         g.csr_vertex_property(vid).root = vid;
-        global_input_tasks[vertex_distributor(vid, threadnum)].push_back(vid);
-
     }
 }
 
-void parallel_wcc(graph_t &g, unsigned threadnum, vector<vector<uint64_t> > &global_input_tasks, gBenchPerf_multi &perf,
-                  int perf_group)
+// in- plus out-degree, the edges a vertex touches in a push round
+inline uint64_t wcc_degree(graph_t &g, uint64_t vid)
 {
+    return g.csr_in_edges_size(vid) + g.csr_out_edges_size(vid);
+}
+
+// Push step: sends the root of a source to all its neighbours with a CAS. A
+// source leaves queued before its root is read, so that a later improvement
+// queues it again; a neighbour whose root dropped is queued once.
+class wcc_push
+{
+public:
+    wcc_push(graph_t &g, bitmap &queued) : _g(g), _queued(queued), _root(0) {}
 
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
+    bool source(uint64_t vid)
+    {
+        _queued.clear_bit_atomic(vid);
+        _root = _g.csr_vertex_property(vid).root;
+        return true;
+    }
+    bool edge(uint64_t, uint64_t dst, uint64_t, uint64_t)
+    {
+        uint64_t old_root = _g.csr_vertex_property(dst).root;
+        while (old_root > _root) {
+            if (__sync_bool_compare_and_swap(&(_g.csr_vertex_property(dst).root), old_root, _root))
+                return _queued.set_bit_atomic(dst);
+            old_root = _g.csr_vertex_property(dst).root;
+        }
+        return false;
+    }
+
+private:
+    graph_t &_g;
+    bitmap &_queued;
+    uint64_t _root;
+};
+
+// Pull step: every vertex takes the smallest root among its neighbours and
+// writes only its own root; changed vertices are marked in next.
+class wcc_pull
+{
+public:
+    wcc_pull(graph_t &g, bitmap &next) : _g(g), _next(next), _root(0), vertices(0), edges(0) {}
+
+    bool target(uint64_t vid)
+    {
+        _root = _g.csr_vertex_property(vid).root;
+        return true;
+    }
+    bool edge(uint64_t, uint64_t src, uint64_t, uint64_t)
+    {
+        uint64_t other = _g.csr_vertex_property(src).root;
+        if (other < _root) _root = other;
+        return false;
+    }
+    void finish(uint64_t vid)
+    {
+        if (_root < _g.csr_vertex_property(vid).root)
+        {
+            _g.csr_vertex_property(vid).root = _root;
+            _next.set_bit_atomic(vid);
+            vertices++;
+            edges += wcc_degree(_g, vid);
+        }
+    }
+
+private:
+    graph_t &_g;
+    bitmap &_next;
+    uint64_t _root;
+public:
+    // size of the next frontier found by this thread
+    uint64_t vertices;
+    uint64_t edges;
+};
 
-    bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks,perf)
+// Label propagation, choosing push or pull for every superstep. A push round
+// sends the root of each frontier vertex to its neighbours with a CAS; a pull
+// round lets every vertex take the smallest root among its neighbours and
+// writes only its own root. Pull is chosen when the frontier touches more
+// than 1/wcc_pull_edge_divisor of all edge endpoints, or holds more than
+// 1/wcc_pull_vertex_divisor of all vertices: many low-degree vertices cost a
+// push round one queue entry and one CAS each, while pulling scans them as
+// bits. In pull rounds the frontier only exists as the current bitmap; it is
+// scanned back into the queue when a push round follows.
+void parallel_wcc(graph_t &g, unsigned threadnum, gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.vertex_num();
+    uint64_t pull_edges = 2 * g.num_edges() / wcc_pull_edge_divisor;
+    uint64_t pull_vertices = vertex_num / wcc_pull_vertex_divisor;
+
+    // in push rounds a vertex's current bit is set while it waits in the
+    // queue, so it is queued at most once per round. In dense form the set
+    // bits are the frontier, which starts out with every vertex.
+    vertex_frontier frontier(vertex_num);
+    bool dense = true;
+    bool pull = false;
+
+    vector<uint64_t> frontier_vertices(threadnum, 0);
+    vector<uint64_t> frontier_edges(threadnum, 0);
+    uint64_t round = 0;
+
+    #pragma omp parallel num_threads(threadnum) shared(frontier,perf)
     {
         unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        queue_buffer<uint64_t> local_queue(frontier.queue);
+        uint64_t slice_begin, slice_end;
+        frontier.thread_range(tid, threadnum, slice_begin, slice_end);
+
+        uint64_t vertices = 0, edges = 0;
+        for (uint64_t vid=slice_begin;vid<slice_end;vid++)
+        {
+            frontier.current_bits().set_bit(vid);
+            vertices++;
+            edges += wcc_degree(g, vid);
+        }
+        frontier_vertices[tid] = vertices;
+        frontier_edges[tid] = edges;
 
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        while(!stop)
+        while (true)
         {
+            // size the frontier; after a dense round the counts are known
+            if (!dense)
+            {
+                const sliding_queue<uint64_t> &queue = frontier.queue;
+                vertices = 0;
+                edges = 0;
+                vertex_map(queue.size(), range_schedule(), [&](uint64_t i) {
+                    vertices++;
+                    edges += wcc_degree(g, queue[i]);
+                });
+                frontier_vertices[tid] = vertices;
+                frontier_edges[tid] = edges;
+            }
             #pragma omp barrier
-            // process local queue
-            stop = true;
-
-
-            for (unsigned i=0;i<input_tasks.size();i++)
+            if (tid==0)
             {
-                uint64_t vid=input_tasks[i];
-                uint64_t size, begin;
-                size = g.csr_in_edges_size(vid);
-                begin = g.csr_in_edges_begin(vid);
-                for (uint64_t i=0;i<size;i++)
+                vertices = 0;
+                edges = 0;
+                for (unsigned i=0;i<threadnum;i++)
                 {
-                    uint64_t dest_vid = g.csr_in_edge(begin,i);
-                    if(g.csr_vertex_property(dest_vid).root > g.csr_vertex_property(vid).root) {
-                        __sync_bool_compare_and_swap(&(g.csr_vertex_property(dest_vid).root), g.csr_vertex_property(dest_vid).root, g.csr_vertex_property(vid).root);
-                        global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                    }
-                }
-
-                size = g.csr_out_edges_size(vid);
-                begin = g.csr_out_edges_begin(vid);
-                for (uint64_t i=0;i<size;i++)
-                {
-                    uint64_t dest_vid = g.csr_out_edge(begin,i);
-
-                    bool done = false;
-                    while(!done) {
-                        if(g.csr_vertex_property(dest_vid).root > g.csr_vertex_property(vid).root) {
-                            done = __sync_bool_compare_and_swap(&(g.csr_vertex_property(dest_vid).root), g.csr_vertex_property(dest_vid).root, g.csr_vertex_property(vid).root);
-                            if(done) {
-                                global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                            }
-                        } else {
-                            done = true;
-                        }
-                    }
+                    vertices += frontier_vertices[i];
+                    edges += frontier_edges[i];
                 }
+                pull = (edges > pull_edges || vertices > pull_vertices);
+                if (vertices > 0)
+                    cout<<"== round "<<round<<": "<<(pull ? "pull" : "push")<<", "
+                        <<vertices<<" vertices, "<<edges<<" edges\n";
+                else
+                    pull = dense = false;
+                round++;
             }
             #pragma omp barrier
-            input_tasks.clear();
-            for (unsigned i=0;i<threadnum;i++)
+            if (!dense && frontier.queue.empty())
+                break;
+
+            if (pull)
             {
-                if (global_output_tasks[i*threadnum+tid].size()!=0)
+                // the current bits already hold the frontier, drop the queue
+                frontier.next_bits().reset(slice_begin, slice_end);
+                #pragma omp barrier
+                if (tid==0)
                 {
-                    stop = false;
-                    input_tasks.insert(input_tasks.end(),
-                                       global_output_tasks[i*threadnum+tid].begin(),
-                                       global_output_tasks[i*threadnum+tid].end());
-                    global_output_tasks[i*threadnum+tid].clear();
+                    frontier.queue.slide_window();
+                    dense = true;
                 }
+
+                wcc_pull step(g, frontier.next_bits());
+                edge_map_pull<ALL_EDGES>(g, vertex_num, dynamic_schedule<1024>(), step);
+                frontier_vertices[tid] = step.vertices;
+                frontier_edges[tid] = step.edges;
+                #pragma omp barrier
+                if (tid==0)
+                    frontier.swap_bits();
+                #pragma omp barrier
+                continue;
             }
-#pragma omp barrier
 
+            if (dense)
+            {
+                // back to a sparse frontier for the push round
+                frontier.to_sparse(local_queue, tid, threadnum);
+                if (tid==0)
+                    dense = false;
+            }
+
+            wcc_push step(g, frontier.current_bits());
+            edge_map_push<ALL_EDGES>(g, frontier.queue, local_queue, dynamic_schedule<64>(), step);
+            #pragma omp barrier
+            if (tid==0)
+                frontier.queue.slide_window();
+            #pragma omp barrier
         }
         perf.stop(tid, perf_group);
     }
 
 }
-#else
-void parallel_init(graph_t& g, unsigned threadnum,
-                   vector<vector<uint64_t> >& global_input_tasks)
+
+// Asynchronous label propagation: a vertex whose root was lowered goes into
+// the worklist right away and may be processed while others still run, with
+// no supersteps. Converges to the same roots as parallel_wcc.
+void parallel_wcc_async(graph_t &g, unsigned threadnum, gBenchPerf_multi &perf, int perf_group)
 {
-    global_input_tasks.resize(threadnum);
-    for (vertex_iterator vit=g.vertices_begin(); vit!=g.vertices_end(); vit++)
+    uint64_t vertex_num = g.vertex_num();
+    async_worklist<uint64_t> worklist(threadnum);
+    // set while a vertex waits in the worklist, cleared before its root is read
+    bitmap queued(vertex_num);
+
+    #pragma omp parallel num_threads(threadnum)
     {
-        vit->property().root = vit->id();
-        global_input_tasks[vertex_distributor(vit->id(), threadnum)].push_back(vit->id());
+        unsigned tid = omp_get_thread_num();
+        vector<uint64_t> chunk;
+        worklist_sink<uint64_t> sink(worklist, tid);
+        wcc_push step(g, queued);
+
+        perf.open(tid, perf_group);
+        perf.start(tid, perf_group);
+
+        #pragma omp for
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            queued.set_bit_atomic(vid);
+            worklist.push(tid, vid);
+        }
+        worklist.flush(tid);
+        #pragma omp barrier
 
+        while (worklist.pop(tid, chunk))
+        {
+            for (size_t k=0;k<chunk.size();k++)
+            {
+                step.source(chunk[k]);
+                push_edges<ALL_EDGES>(g, chunk[k], step, sink);
+            }
+            worklist.done(tid, chunk.size());
+        }
+        perf.stop(tid, perf_group);
     }
+
+    cout<<"== async: "<<worklist.steals()<<" chunks stolen\n";
 }
 
-void parallel_wcc(graph_t &g, unsigned threadnum, vector<vector<uint64_t> > &global_input_tasks, gBenchPerf_multi &perf,
-                  int perf_group)
+// Union-find over the root property after Shiloach-Vishkin and Afforest
+// (Sutton et al.). A root only ever points to a smaller vertex id, so every
+// tree is rooted at its minimum internal id, the same component id label
+// propagation converges to.
+
+// hook the trees of u and v together, the larger root under the smaller one
+inline void wcc_link(graph_t &g, uint64_t u, uint64_t v)
 {
+    uint64_t p1 = g.csr_vertex_property(u).root;
+    uint64_t p2 = g.csr_vertex_property(v).root;
+    while (p1 != p2)
+    {
+        uint64_t high = (p1 > p2) ? p1 : p2;
+        uint64_t low = p1 + p2 - high;
+        uint64_t p_high = g.csr_vertex_property(high).root;
+        if (p_high == low)
+            break;
+        if (p_high == high && __sync_bool_compare_and_swap(&(g.csr_vertex_property(high).root), high, low))
+            break;
+        p1 = g.csr_vertex_property(g.csr_vertex_property(high).root).root;
+        p2 = g.csr_vertex_property(low).root;
+    }
+}
 
-    vector<vector<uint64_t> > global_output_tasks(threadnum*threadnum);
+// point every vertex straight at its tree root
+inline void wcc_compress(graph_t &g, uint64_t vid)
+{
+    while (g.csr_vertex_property(vid).root != g.csr_vertex_property(g.csr_vertex_property(vid).root).root)
+    {
+        g.csr_vertex_property(vid).root = g.csr_vertex_property(g.csr_vertex_property(vid).root).root;
+    }
+}
 
-    bool stop = false;
-    #pragma omp parallel num_threads(threadnum) shared(stop,global_input_tasks,global_output_tasks,perf)
+// most frequent root among a few random vertices, likely the giant component
+uint64_t wcc_sample_frequent_root(graph_t &g, uint64_t &frequency, unsigned samples = 1024)
+{
+    uint64_t vertex_num = g.vertex_num();
+    unordered_map<uint64_t, uint64_t> counts;
+    mt19937_64 rng(27491095);
+    uniform_int_distribution<uint64_t> dist(0, vertex_num - 1);
+    for (unsigned i=0;i<samples;i++)
+        counts[g.csr_vertex_property(dist(rng)).root]++;
+
+    uint64_t best = 0;
+    frequency = 0;
+    for (unordered_map<uint64_t, uint64_t>::iterator it=counts.begin();it!=counts.end();it++)
     {
-        unsigned tid = omp_get_thread_num();
-        vector<uint64_t> & input_tasks = global_input_tasks[tid];
+        if (it->second > frequency || (it->second == frequency && it->first < best))
+        {
+            best = it->first;
+            frequency = it->second;
+        }
+    }
+    frequency = frequency * 100 / samples;
+    return best;
+}
+
+// With sample_rounds > 0, each vertex first links only its first
+// sample_rounds out-neighbours. The most frequent root is then sampled, and
+// vertices already in that component skip their remaining edges; every
+// other vertex links its remaining out-edges and all in-edges, so edges into
+// the skipped component are still seen from their other end. With
+// sample_rounds == 0 all out-edges are linked.
+void parallel_wcc_unionfind(graph_t &g, unsigned threadnum, unsigned sample_rounds,
+                            gBenchPerf_multi &perf, int perf_group)
+{
+    uint64_t vertex_num = g.vertex_num();
+    uint64_t skip_root = vertex_num;
+    uint64_t skip_frequency = 0;
 
+    #pragma omp parallel num_threads(threadnum)
+    {
+        unsigned tid = omp_get_thread_num();
         perf.open(tid, perf_group);
         perf.start(tid, perf_group);
-        while(!stop)
+
+        for (unsigned r=0;r<sample_rounds;r++)
         {
+            #pragma omp for schedule(dynamic, 16384)
+            for (uint64_t vid=0;vid<vertex_num;vid++)
+            {
+                if (r < g.csr_out_edges_size(vid))
+                    wcc_link(g, vid, g.csr_out_edge(g.csr_out_edges_begin(vid), r));
+            }
+            #pragma omp for schedule(dynamic, 16384)
+            for (uint64_t vid=0;vid<vertex_num;vid++)
+                wcc_compress(g, vid);
+        }
+
+        if (sample_rounds > 0 && vertex_num > 0)
+        {
+            if (tid==0)
+                skip_root = wcc_sample_frequent_root(g, skip_frequency);
             #pragma omp barrier
-            // process local queue
-            stop = true;
+        }
 
+        #pragma omp for schedule(dynamic, 16384)
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+        {
+            if (g.csr_vertex_property(vid).root == skip_root)
+                continue;
 
-            for (unsigned i=0;i<input_tasks.size();i++)
-            {
-                uint64_t vid=input_tasks[i];
-                vertex_iterator vit = g.find_vertex(vid);
+            uint64_t size = g.csr_out_edges_size(vid);
+            uint64_t begin = g.csr_out_edges_begin(vid);
+            for (uint64_t i=sample_rounds;i<size;i++)
+                wcc_link(g, vid, g.csr_out_edge(begin,i));
 
-                for (edge_iterator eit=vit->in_edges_begin();eit!=vit->in_edges_end();eit++)
-                {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator destvit = g.find_vertex(dest_vid);
-                    if(destvit->property().root > vit->property().root) {
-                        __sync_bool_compare_and_swap(&(destvit->property().root), destvit->property().root, vit->property().root);
-                        global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                    }
-                }
-                for (edge_iterator eit=vit->out_edges_begin();eit!=vit->out_edges_end();eit++)
-                {
-                    uint64_t dest_vid = eit->target();
-                    vertex_iterator destvit = g.find_vertex(dest_vid);
-
-
-                    bool done = false;
-                    while(!done) {
-                        if(destvit->property().root > vit->property().root) {
-                            done = __sync_bool_compare_and_swap(&(destvit->property().root), destvit->property().root, vit->property().root);
-                            if(done) {
-                                global_output_tasks[vertex_distributor(dest_vid,threadnum)+tid*threadnum].push_back(dest_vid);
-                            }
-                        } else {
-                            done = true;
-                        }
-                    }
-                }
-            }
-            #pragma omp barrier
-            input_tasks.clear();
-            for (unsigned i=0;i<threadnum;i++)
+            if (sample_rounds > 0)
             {
-                if (global_output_tasks[i*threadnum+tid].size()!=0)
-                {
-                    stop = false;
-                    input_tasks.insert(input_tasks.end(),
-                                       global_output_tasks[i*threadnum+tid].begin(),
-                                       global_output_tasks[i*threadnum+tid].end());
-                    global_output_tasks[i*threadnum+tid].clear();
-                }
+                size = g.csr_in_edges_size(vid);
+                begin = g.csr_in_edges_begin(vid);
+                for (uint64_t i=0;i<size;i++)
+                    wcc_link(g, vid, g.csr_in_edge(begin,i));
             }
-#pragma omp barrier
-
         }
+
+        #pragma omp for schedule(dynamic, 16384)
+        for (uint64_t vid=0;vid<vertex_num;vid++)
+            wcc_compress(g, vid);
+
         perf.stop(tid, perf_group);
     }
 
+    if (sample_rounds > 0)
+        cout<<"== afforest: skipped component "<<skip_root<<" holding ~"<<skip_frequency
+            <<"% of the sampled vertices\n";
 }
-#endif
 void output(graph_t& g)
 {
     cout<<"WCC Results: \n";
@@ -311,7 +526,19 @@ int main(int argc, char * argv[])
 
     size_t threadnum;
     arg.get_value("threadnum",threadnum);
+    string numa_mode;
+    arg.get_value("numa",numa_mode);
+    if (numa_mode != "interleave" && numa_mode != "none") {
+        cerr << "unknown numa mode: " << numa_mode << endl;
+        return 1;
+    }
     arg.get_value("jobid",jobId);
+    string mode;
+    arg.get_value("mode",mode);
+    if (mode != "afforest" && mode != "unionfind" && mode != "label" && mode != "async") {
+        cerr << "unknown wcc mode: " << mode << endl;
+        return 1;
+    }
 
 #ifdef GRANULA
     granula::linkNode(jobId);
@@ -327,18 +554,11 @@ int main(int argc, char * argv[])
     cout<<loadGraph.getOperationInfo("StartTime", loadGraph.getEpoch())<<endl;
 #endif
 
+    numa_placement placement(numa_mode, threadnum);
+    placement.before_load();
     t1 = timer::get_usec();
-    string vfile = path + "/vertex.csv";
-    string efile = path + "/edge.csv";
-#ifdef USE_CSR
     if (!graph.load_CSR_Graph(path))
         return -1;
-#else
-    if (!graph.load_csv_vertices(vfile, false, " ", 0))
-        return -1;
-    if (!graph.load_csv_edges(efile, false, " ", 0, 1))
-        return -1;
-#endif
 
     size_t vertex_num = graph.vertex_num();
     size_t edge_num = graph.edge_num();
@@ -363,11 +583,17 @@ int main(int argc, char * argv[])
 
     for (unsigned i=0;i<run_num;i++)
     {
-        vector<vector<uint64_t> > global_input_tasks(threadnum);
-        parallel_init(graph,threadnum,global_input_tasks);
+        parallel_init(graph,threadnum);
 
         t1 = timer::get_usec();
-        parallel_wcc(graph, threadnum, global_input_tasks, perf_multi, i);
+        if (mode == "afforest")
+            parallel_wcc_unionfind(graph, threadnum, afforest_sample_rounds, perf_multi, i);
+        else if (mode == "async")
+            parallel_wcc_async(graph, threadnum, perf_multi, i);
+        else if (mode == "unionfind")
+            parallel_wcc_unionfind(graph, threadnum, 0, perf_multi, i);
+        else
+            parallel_wcc(graph, threadnum, perf_multi, i);
         t2 = timer::get_usec();
         elapse_time += t2-t1;
         if ((i+1)<run_num) reset_graph(graph);
@@ -393,11 +619,7 @@ int main(int argc, char * argv[])
     arg.get_value("output", output_file);
     
     if (!output_file.empty()) {
-#ifdef USE_CSR
         write_csr_graph_vertices(graph, output_file, true);
-#else
-        write_graph_vertices(graph, output_file);
-#endif
     }
 
 #ifdef GRANULA
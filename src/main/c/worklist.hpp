@@ -0,0 +1,186 @@
+/*
+ * Copyright 2015 Delft University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WORKLIST_H
+#define WORKLIST_H
+
+#include <cstddef>
+#include <deque>
+#include <sched.h>
+#include <stdint.h>
+#include <vector>
+
+// Worklist for asynchronous kernels, which process an update as soon as it is
+// produced instead of in barrier-separated rounds.
+//
+// Each thread fills a private chunk. Full chunks move to the thread's own
+// deque, where the owner takes them from the front and idle threads steal
+// them from the back. Termination is detected with a single counter of
+// published but unfinished items. done() publishes the chunk the thread
+// filled before it retires the chunk it processed, so the counter can only
+// reach zero when no work is left anywhere.
+template <typename T>
+class async_worklist
+{
+public:
+    explicit async_worklist(unsigned threadnum, size_t chunk_size = 256)
+        : _threadnum(threadnum), _chunk_size(chunk_size), _pending(0), _threads(threadnum)
+    {
+    }
+
+    void push(unsigned tid, T item)
+    {
+        std::vector<T> &open = _threads[tid].open;
+        open.push_back(item);
+        if (open.size() >= _chunk_size)
+            flush(tid);
+    }
+
+    // publish the items tid pushed since its last flush
+    void flush(unsigned tid)
+    {
+        thread_state &state = _threads[tid];
+        if (state.open.empty())
+            return;
+        __sync_fetch_and_add(&_pending, (uint64_t) state.open.size());
+        lock(state);
+        state.chunks.push_back(std::vector<T>());
+        state.chunks.back().swap(state.open);
+        state.available++;
+        unlock(state);
+        state.open.reserve(_chunk_size);
+    }
+
+    // next chunk for tid to process; false once all work is done
+    bool pop(unsigned tid, std::vector<T> &chunk)
+    {
+        thread_state &state = _threads[tid];
+        while (true)
+        {
+            if (take(state, chunk, true))
+                return true;
+            for (unsigned i=1;i<_threadnum;i++)
+            {
+                if (take(_threads[(tid + i) % _threadnum], chunk, false))
+                {
+                    state.steals++;
+                    return true;
+                }
+            }
+            if (*(volatile uint64_t *) &_pending == 0)
+                return false;
+            // let busy threads run if the machine is oversubscribed
+            sched_yield();
+        }
+    }
+
+    // retire the count items of the chunk tid took with pop
+    void done(unsigned tid, size_t count)
+    {
+        flush(tid);
+        __sync_fetch_and_sub(&_pending, (uint64_t) count);
+    }
+
+    // chunks taken from another thread's deque so far
+    uint64_t steals(void) const
+    {
+        uint64_t sum = 0;
+        for (unsigned i=0;i<_threadnum;i++)
+            sum += _threads[i].steals;
+        return sum;
+    }
+
+private:
+    // padded so that owners do not share their lock's cache line
+    struct thread_state
+    {
+        thread_state() : available(0), lock(0), steals(0) {}
+
+        std::deque<std::vector<T> > chunks;
+        std::vector<T> open;
+        // chunks.size(), readable without the lock
+        volatile size_t available;
+        volatile bool lock;
+        uint64_t steals;
+        char pad[64];
+    };
+
+    static void lock(thread_state &state)
+    {
+        while (__sync_lock_test_and_set(&(state.lock), 1));
+    }
+
+    static void unlock(thread_state &state)
+    {
+        __sync_lock_release(&(state.lock));
+    }
+
+    static bool take(thread_state &state, std::vector<T> &chunk, bool owner)
+    {
+        if (state.available == 0)
+            return false;
+        lock(state);
+        bool found = !state.chunks.empty();
+        if (found)
+        {
+            state.available--;
+            if (owner)
+            {
+                chunk.swap(state.chunks.front());
+                state.chunks.pop_front();
+            }
+            else
+            {
+                chunk.swap(state.chunks.back());
+                state.chunks.pop_back();
+            }
+        }
+        unlock(state);
+        return found;
+    }
+
+    async_worklist(const async_worklist &);
+    async_worklist & operator=(const async_worklist &);
+
+    unsigned _threadnum;
+    size_t _chunk_size;
+    uint64_t _pending;
+    std::vector<thread_state> _threads;
+};
+
+// queue_buffer-like front end of an async_worklist for one thread, so that
+// the push operators of engine.hpp can feed the worklist
+template <typename T>
+class worklist_sink
+{
+public:
+    worklist_sink(async_worklist<T> &worklist, unsigned tid) : _worklist(worklist), _tid(tid) {}
+
+    void push_back(T item)
+    {
+        _worklist.push(_tid, item);
+    }
+
+    void flush(void)
+    {
+        _worklist.flush(_tid);
+    }
+
+private:
+    async_worklist<T> &_worklist;
+    unsigned _tid;
+};
+
+#endif